@@ -0,0 +1,337 @@
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <librsvg/rsvg.h>
+
+#include "config.h"
+#include "theme.h"
+
+// clok4-theme-profile: per-layer cost report for a clok4 theme directory
+//
+//   clok4-theme-profile [--sizes=128,256,512,1024] [--runs=3] THEMEDIR
+//
+// For each layer file: parse time, rasterization time and raster memory at a
+// sweep of sizes, element usage and the alpha bounding box. Dynamic layers
+// (hands) are redrawn whenever they move, so filters, large embedded bitmaps
+// and huge path counts on them are flagged, as are dynamic layers that cannot
+// be scanned for them, and the exit status is 1 when anything was flagged.
+// Layers are loaded with the same loader as clok4, and static layers shipping
+// pre-rendered FILE@SIZE assets are reported by those, which clok4 draws
+// instead of the SVG.
+
+#define PROFILE_SIZES         "128,256,512,1024"
+#define PROFILE_RUNS          3  // rasterizations per size, the fastest counts
+#define MAX_HAND_PATHS        200
+#define MAX_HAND_BITMAP_BYTES (64 * 1024)
+
+typedef struct {
+    guint elements;
+    guint paths;  // shapes of any kind
+    guint filters;
+    guint gradients;
+    guint images;
+    guint masks;  // masks and clip paths
+    gsize bitmap_bytes;  // decoded size of embedded data: URIs
+} SvgUsage;
+
+static const char *local_name(const char *name) {
+    const char *colon = strrchr(name, ':');
+    return colon ? colon + 1 : name;
+}
+
+static void on_svg_element(GMarkupParseContext *context, const gchar *element_name, const gchar **attribute_names,
+                           const gchar **attribute_values, gpointer user_data, GError **error) {
+    static const char *const shapes[] = {"path", "rect", "circle", "ellipse", "line", "polyline", "polygon"};
+    SvgUsage *usage = user_data;
+    const char *name = local_name(element_name);
+
+    usage->elements++;
+    for (size_t i = 0; i < G_N_ELEMENTS(shapes); i++) {
+        if (!strcmp(name, shapes[i]))
+            usage->paths++;
+    }
+    if (!strcmp(name, "filter"))
+        usage->filters++;
+    else if (!strcmp(name, "linearGradient") || !strcmp(name, "radialGradient"))
+        usage->gradients++;
+    else if (!strcmp(name, "image"))
+        usage->images++;
+    else if (!strcmp(name, "mask") || !strcmp(name, "clipPath"))
+        usage->masks++;
+
+    for (int i = 0; attribute_names[i]; i++) {
+        if (!strcmp(local_name(attribute_names[i]), "href") && g_str_has_prefix(attribute_values[i], "data:"))
+            usage->bitmap_bytes += strlen(attribute_values[i]) / 4 * 3;
+    }
+}
+
+static gboolean scan_svg(const char *path, SvgUsage *usage, GError **error) {
+    static const GMarkupParser parser = {.start_element = on_svg_element};
+    gchar *contents;
+    gsize length;
+
+    memset(usage, 0, sizeof(*usage));
+    if (!g_file_get_contents(path, &contents, &length, error))
+        return FALSE;
+    GMarkupParseContext *context = g_markup_parse_context_new(&parser, 0, usage, NULL);
+    gboolean ok = g_markup_parse_context_parse(context, contents, length, error) &&
+                  g_markup_parse_context_end_parse(context, error);
+    g_markup_parse_context_free(context);
+    g_free(contents);
+    return ok;
+}
+
+// Fastest of runs rasterizations at size x size pixels, in microseconds; the
+// last raster is returned in surface
+static gint64 profile_raster(RsvgHandle *handle, const RsvgRectangle *viewport, int size, int runs,
+                             cairo_surface_t **surface) {
+    gint64 best = G_MAXINT64;
+    *surface = NULL;
+
+    for (int run = 0; run < runs; run++) {
+        if (*surface)
+            cairo_surface_destroy(*surface);
+        *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+        cairo_t *cr = cairo_create(*surface);
+        cairo_scale(cr, size / viewport->width, size / viewport->height);
+
+        gint64 start = g_get_monotonic_time();
+        rsvg_handle_render_document(handle, cr, viewport, NULL);
+        cairo_surface_flush(*surface);
+        best = MIN(best, g_get_monotonic_time() - start);
+        cairo_destroy(cr);
+    }
+    return best;
+}
+
+// Bounding box of the non-transparent pixels, FALSE if there are none
+static gboolean alpha_bounds(cairo_surface_t *surface, int *x0, int *y0, int *x1, int *y1) {
+    int w = cairo_image_surface_get_width(surface);
+    int h = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    const unsigned char *data = cairo_image_surface_get_data(surface);
+
+    *x0 = w;
+    *y0 = h;
+    *x1 = *y1 = -1;
+    for (int y = 0; y < h; y++) {
+        const guint32 *row = (const guint32 *)(data + y * stride);
+        for (int x = 0; x < w; x++) {
+            if (row[x] >> 24) {
+                *x0 = MIN(*x0, x);
+                *y0 = MIN(*y0, y);
+                *x1 = MAX(*x1, x);
+                *y1 = MAX(*y1, y);
+            }
+        }
+    }
+    return *x1 >= 0;
+}
+
+// Pre-rendered assets of a static layer, which clok4 decodes instead of rasterizing the SVG
+static void report_rasters(GPtrArray *rasters) {
+    g_print("  size    file KiB    asset\n");
+    for (guint i = 0; i < rasters->len; i++) {
+        const ThemeRaster *raster = g_ptr_array_index(rasters, i);
+        GStatBuf st;
+        gchar *name = g_path_get_basename(raster->path);
+        g_print("  %-7d %-11" G_GINT64_FORMAT " %s\n", raster->size,
+                g_stat(raster->path, &st) ? (gint64)0 : (gint64)st.st_size / 1024, name);
+        g_free(name);
+    }
+}
+
+static int *parse_sizes(const char *list, int *n_sizes) {
+    gchar **items = g_strsplit(list, ",", -1);
+    int *sizes = g_new0(int, g_strv_length(items));
+    *n_sizes = 0;
+    for (int i = 0; items[i]; i++) {
+        int size = atoi(g_strstrip(items[i]));
+        if (size < 1 || size > 8192) {
+            g_printerr("Invalid size %s\n", items[i]);
+            continue;
+        }
+        sizes[(*n_sizes)++] = size;
+    }
+    g_strfreev(items);
+    return sizes;
+}
+
+int main(int argc, char **argv) {
+    gchar *size_list = NULL;
+    int runs = PROFILE_RUNS;
+    gboolean show_version = FALSE;
+    GError *error = NULL;
+    GOptionEntry entries[] = {
+        {"sizes", 's', 0, G_OPTION_ARG_STRING, &size_list, "Raster sizes to profile (" PROFILE_SIZES ")", "LIST"},
+        {"runs", 'r', 0, G_OPTION_ARG_INT, &runs, "Rasterizations per size, the fastest counts", "N"},
+        {"version", 'v', 0, G_OPTION_ARG_NONE, &show_version, "Show application version and exit", NULL},
+        {NULL}
+    };
+
+    GOptionContext *context = g_option_context_new("THEMEDIR - Report the rendering cost of a clok4 theme");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("Option parsing failed: %s\n", error->message);
+        g_clear_error(&error);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (show_version) {
+        g_print("clok4-theme-profile version %s\n", PROJECT_VERSION);
+        return 0;
+    }
+    if (argc != 2) {
+        g_printerr("Usage: %s [OPTION...] THEMEDIR\n", argv[0]);
+        return 2;
+    }
+    if (runs < 1)
+        runs = 1;
+
+    const char *dir = argv[1];
+    int n_sizes;
+    int *sizes = parse_sizes(size_list ? size_list : PROFILE_SIZES, &n_sizes);
+    g_free(size_list);
+    if (!n_sizes) {
+        g_printerr("No valid sizes\n");
+        return 2;
+    }
+
+    // Theme canvas from the drop shadow's intrinsic size, or the hour hand's
+    // when the drop shadow comes as raster assets only, as in clok4
+    RsvgRectangle viewport = {0.0, 0.0, 100.0, 100.0};
+    GPtrArray *shadow_rasters = theme_find_rasters(dir, layer_files[CLOCK_DROP_SHADOW].file);
+    LayerElement canvas_layer = shadow_rasters ? CLOCK_HOUR_HAND : CLOCK_DROP_SHADOW;
+    if (shadow_rasters)
+        g_ptr_array_unref(shadow_rasters);
+    RsvgHandle *canvas = theme_load_svg(dir, layer_files[canvas_layer].file, &error);
+    if (!canvas) {
+        g_printerr("%s is not a theme: %s\n", dir, error->message);
+        g_clear_error(&error);
+        return 2;
+    }
+    double w, h;
+    if (rsvg_handle_get_intrinsic_size_in_pixels(canvas, &w, &h) && w >= 1.0 && h >= 1.0) {
+        viewport.width = ceil(w);
+        viewport.height = ceil(h);
+    }
+    g_object_unref(canvas);
+    g_print("Theme %s, canvas %gx%g\n", dir, viewport.width, viewport.height);
+
+    gint64 *hand_usec = g_new0(gint64, n_sizes);  // per-frame redraw cost of all hands
+    guint flagged = 0;
+
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        const char *file = layer_files[e].file;
+        gboolean dynamic = layer_is_dynamic(e);
+        GPtrArray *rasters = dynamic ? NULL : theme_find_rasters(dir, file);
+        if (rasters) {
+            g_print("\n%s (static, raster assets)\n", file);
+            report_rasters(rasters);
+            g_ptr_array_unref(rasters);
+            continue;
+        }
+
+        gchar *path = g_build_filename(dir, file, NULL);
+        if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+            if (layer_files[e].needed) {
+                g_print("\n%s: MISSING, the theme cannot be used\n", file);
+                flagged++;
+            }
+            g_free(path);
+            continue;
+        }
+
+        gint64 start = g_get_monotonic_time();
+        RsvgHandle *handle = theme_load_svg(dir, file, &error);
+        gint64 parse_usec = g_get_monotonic_time() - start;
+        g_print("\n%s (%s)\n", file, dynamic ? "dynamic" : "static");
+        if (!handle) {
+            g_print("  cannot load: %s\n", error->message);
+            g_clear_error(&error);
+            g_free(path);
+            flagged++;
+            continue;
+        }
+        g_print("  parse        %.2f ms\n", parse_usec / 1000.0);
+
+        SvgUsage usage;
+        gboolean scanned = scan_svg(path, &usage, &error);
+        if (scanned) {
+            g_print("  elements     %u: %u shapes, %u filters, %u gradients, %u masks, %u images (%" G_GSIZE_FORMAT
+                    " KiB embedded)\n",
+                    usage.elements, usage.paths, usage.filters, usage.gradients, usage.masks, usage.images,
+                    usage.bitmap_bytes / 1024);
+        } else {
+            g_print("  elements     not counted: %s\n", error->message);
+            g_clear_error(&error);
+        }
+
+        g_print("  size    raster ms   memory KiB\n");
+        cairo_surface_t *largest = NULL;
+        for (int i = 0; i < n_sizes; i++) {
+            cairo_surface_t *surface;
+            gint64 usec = profile_raster(handle, &viewport, sizes[i], runs, &surface);
+            g_print("  %-7d %-11.2f %d\n", sizes[i], usec / 1000.0, sizes[i] * sizes[i] * 4 / 1024);
+            if (dynamic)
+                hand_usec[i] += usec;
+            if (!largest || sizes[i] > cairo_image_surface_get_width(largest)) {
+                if (largest)
+                    cairo_surface_destroy(largest);
+                largest = surface;
+            } else {
+                cairo_surface_destroy(surface);
+            }
+        }
+
+        int x0, y0, x1, y1;
+        if (alpha_bounds(largest, &x0, &y0, &x1, &y1)) {
+            double scale = viewport.width / cairo_image_surface_get_width(largest);
+            g_print("  alpha bbox   (%.1f,%.1f)-(%.1f,%.1f) theme units, %.1f%% of the canvas\n", x0 * scale,
+                    y0 * scale, (x1 + 1) * scale, (y1 + 1) * scale,
+                    100.0 * (x1 - x0 + 1) * (y1 - y0 + 1) / ((double)cairo_image_surface_get_width(largest) *
+                                                             cairo_image_surface_get_height(largest)));
+        } else {
+            g_print("  alpha bbox   empty, the layer draws nothing\n");
+        }
+        cairo_surface_destroy(largest);
+
+        if (dynamic && !scanned) {
+            // librsvg may render what GMarkup cannot parse, e.g. entity references
+            g_print("  ! dynamic layer not checked for filters, bitmaps and shapes\n");
+            flagged++;
+        } else if (dynamic) {
+            if (usage.filters) {
+                g_print("  ! %u filters on a layer redrawn whenever the hand moves\n", usage.filters);
+                flagged++;
+            }
+            if (usage.bitmap_bytes > MAX_HAND_BITMAP_BYTES) {
+                g_print("  ! %" G_GSIZE_FORMAT " KiB of embedded bitmaps on a dynamic layer\n",
+                        usage.bitmap_bytes / 1024);
+                flagged++;
+            }
+            if (usage.paths > MAX_HAND_PATHS) {
+                g_print("  ! %u shapes on a dynamic layer (at most %d recommended)\n", usage.paths, MAX_HAND_PATHS);
+                flagged++;
+            }
+        }
+
+        g_object_unref(handle);
+        g_free(path);
+    }
+
+    g_print("\nHands redrawn per frame\n  size    raster ms\n");
+    for (int i = 0; i < n_sizes; i++) {
+        g_print("  %-7d %.2f\n", sizes[i], hand_usec[i] / 1000.0);
+    }
+    if (flagged)
+        g_print("\n%u problem%s flagged\n", flagged, flagged == 1 ? "" : "s");
+
+    g_free(hand_usec);
+    g_free(sizes);
+    return flagged ? 1 : 0;
+}
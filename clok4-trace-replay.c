@@ -0,0 +1,339 @@
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include "config.h"
+#include "scheduler.h"
+
+// clok4-trace-replay: run clok4's redraw scheduler over a recorded frame-clock
+// timeline, without GTK or a display
+//
+//   clok4-trace-replay [--hz=HZ] [--[no]railway] [--[no]seconds] [--max-wakeups=N] ... TRACE
+//
+// Traces come from clok4 --record-trace or are written by hand, one event per
+// line, times in microseconds on the monotonic clock. The settings line clok4
+// writes first, e.g. "# clok4 0.4.3 frame-clock trace, 5 hz, railway, no
+// seconds; times in usec", replays the trace with those settings unless the
+// options given override them. Other lines:
+//   frame FRAME_TIME [REFRESH_INTERVAL [REALTIME]]
+//   presented FRAME_TIME PRESENTATION_TIME
+//   step DELTA      the wall clock jumps by DELTA from the next frame on
+//   overlay HZ      overlays animate at HZ from the next frame on, 0 stops them
+// A frame without REFRESH_INTERVAL keeps the previous one, and without REALTIME
+// the wall clock advances with the frame time. Dropped frames are gaps between
+// frame times. Frames arriving while the scheduler rests are not seen by it,
+// as in clok4, and the frame after the rest ends counts as a timer resume.
+//
+// Reports redraws, skipped ticks, wakeups and the phase error of the sweeping
+// hand redraws: how far each redraw's presentation time is from the ideal grid
+// of redraw intervals, anchored where a sweep starts. Exit status 1 when a
+// --min/--max bound is not met, so scheduler changes can be gated on traces
+
+typedef struct {
+    gint64 frame_time;
+    gint64 refresh_interval;
+    gint64 realtime;
+    gint64 presented;  // 0 if unknown
+    int overlay_hz;
+} TraceFrame;
+
+static gint64 parse_usec(const char *s, gboolean *ok) {
+    char *end;
+    gint64 v = g_ascii_strtoll(s, &end, 10);
+    if (end == s || *end)
+        *ok = FALSE;
+    return v;
+}
+
+// Settings from the comment clok4 --record-trace starts a trace with; FALSE
+// if line is not that comment
+static gboolean parse_trace_header(const char *line, ScheduleSettings *settings) {
+    const char *tag = strstr(line, "frame-clock trace,");
+    if (line[0] != '#' || !tag)
+        return FALSE;
+    gchar *list = g_strdup(tag + strlen("frame-clock trace,"));
+    char *end = strchr(list, ';');
+    if (end)
+        *end = '\0';
+
+    ScheduleSettings parsed = {.hz = 0, .seconds = TRUE};
+    gchar **items = g_strsplit(list, ",", -1);
+    for (int i = 0; items[i]; i++) {
+        const char *item = g_strstrip(items[i]);
+        if (!strcmp(item, "railway"))
+            parsed.railway = TRUE;
+        else if (!strcmp(item, "no seconds"))
+            parsed.seconds = FALSE;
+        else if (g_str_has_suffix(item, " hz"))
+            parsed.hz = atoi(item);
+    }
+    g_strfreev(items);
+    g_free(list);
+    if (parsed.hz < 1 || parsed.hz > 240)
+        return FALSE;
+    *settings = parsed;
+    return TRUE;
+}
+
+// Frames of the trace at path; *settings is set from its settings line, if it has one
+static GArray *load_trace(const char *path, gint64 start_realtime, ScheduleSettings *settings, gboolean *has_settings,
+                          GError **error) {
+    gchar *contents;
+    if (!g_file_get_contents(path, &contents, NULL, error))
+        return NULL;
+
+    GArray *frames = g_array_new(FALSE, TRUE, sizeof(TraceFrame));
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    gint64 refresh_interval = 0, realtime = start_realtime, step = 0, previous = 0;
+    int overlay_hz = 0;
+    for (int n = 0; lines[n]; n++) {
+        gchar **f = g_strsplit_set(g_strstrip(lines[n]), " \t", -1);
+        guint count = g_strv_length(f);
+        gboolean ok = TRUE;
+
+        if (!count || !*f[0] || f[0][0] == '#') {
+            // blank or comment
+            if (!*has_settings && !frames->len)
+                *has_settings = parse_trace_header(lines[n], settings);
+        } else if (!strcmp(f[0], "frame") && count >= 2 && count <= 4) {
+            TraceFrame frame = {.frame_time = parse_usec(f[1], &ok)};
+            if (count >= 3)
+                refresh_interval = parse_usec(f[2], &ok);
+            if (count == 4)
+                realtime = parse_usec(f[3], &ok) + step;
+            else if (frames->len)
+                realtime += frame.frame_time - previous;
+            frame.refresh_interval = refresh_interval;
+            frame.realtime = realtime;
+            frame.overlay_hz = overlay_hz;
+            ok = ok && frame.frame_time > 0 && frame.refresh_interval >= 0;
+            if (ok)
+                g_array_append_val(frames, frame);
+            previous = frame.frame_time;
+        } else if (!strcmp(f[0], "presented") && count == 3) {
+            gint64 frame_time = parse_usec(f[1], &ok);
+            gint64 presented = parse_usec(f[2], &ok);
+            // Presentation lines may come a few frames late; search backwards
+            for (guint i = frames->len; ok && i-- > 0;) {
+                TraceFrame *frame = &g_array_index(frames, TraceFrame, i);
+                if (frame->frame_time == frame_time) {
+                    frame->presented = presented;
+                    break;
+                }
+            }
+        } else if (!strcmp(f[0], "step") && count == 2) {
+            gint64 delta = parse_usec(f[1], &ok);
+            step += delta;
+            realtime += delta;
+        } else if (!strcmp(f[0], "overlay") && count == 2) {
+            overlay_hz = (int)parse_usec(f[1], &ok);
+            ok = ok && overlay_hz >= 0 && overlay_hz <= 1000;
+        } else {
+            ok = FALSE;
+        }
+        g_strfreev(f);
+
+        if (!ok) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s:%d: invalid line", path, n + 1);
+            g_strfreev(lines);
+            g_array_unref(frames);
+            return NULL;
+        }
+    }
+    g_strfreev(lines);
+    return frames;
+}
+
+typedef struct {
+    guint ticks;           // tick callbacks
+    guint resumes;         // timer resumes after resting
+    guint rested;          // frames the scheduler did not see
+    guint redraws;         // frames drawn
+    guint hand_redraws;
+    guint skipped;         // ticks that drew nothing
+    guint phase_samples;
+    double phase_sum, phase_max;  // usec
+} ReplayStats;
+
+static void replay(const GArray *frames, const ScheduleSettings *settings, ReplayStats *stats) {
+    ClockScheduler scheduler = {0};
+    gboolean ticking = TRUE;
+    gint64 resume_at = 0;
+    gint64 anchor = 0, anchor_interval = 0;  // start of the current sweep, in presentation time
+
+    memset(stats, 0, sizeof(*stats));
+    clock_scheduler_reset(&scheduler);
+    for (guint i = 0; i < frames->len; i++) {
+        const TraceFrame *frame = &g_array_index(frames, TraceFrame, i);
+
+        if (!ticking) {
+            if (frame->frame_time < resume_at) {
+                stats->rested++;
+                continue;
+            }
+            stats->resumes++;
+            clock_scheduler_reset(&scheduler);
+            ticking = TRUE;
+        }
+        stats->ticks++;
+
+        struct timespec ts = {frame->realtime / G_USEC_PER_SEC, frame->realtime % G_USEC_PER_SEC * 1000};
+        gint64 previous_frame = scheduler.clock_pacer.last_frame_time;
+        ScheduleDecision decision;
+        clock_scheduler_step(&scheduler, settings, &ts, frame->frame_time, frame->refresh_interval,
+                             frame->overlay_hz, &decision);
+
+        if (decision.rest_usec) {
+            // clok4 resumes from a millisecond timeout and draws the resting hands once
+            resume_at = frame->frame_time + (decision.rest_usec + 999) / 1000 * 1000;
+            ticking = FALSE;
+            anchor = 0;
+            stats->redraws++;
+            stats->hand_redraws += decision.hands;
+            continue;
+        }
+        if (!decision.hands && !decision.overlays) {
+            stats->skipped++;
+            continue;
+        }
+        stats->redraws++;
+        if (!decision.hands)
+            continue;
+        stats->hand_redraws++;
+
+        // Phase error of sweeping redraws against the grid started by the first
+        // redraw of the sweep; the pacer starts afresh after stalls and bursts
+        gint64 shown = frame->presented ? frame->presented : frame->frame_time;
+        gint64 interval = scheduler.sweep_interval;
+        gboolean fresh = !previous_frame || frame->frame_time - previous_frame > G_USEC_PER_SEC ||
+                         frame->frame_time <= previous_frame;
+        if (decision.motion != MOTION_SWEEP) {
+            anchor = 0;
+        } else if (!anchor || fresh || interval != anchor_interval) {
+            anchor = shown;
+            anchor_interval = interval;
+        } else {
+            double since = shown - anchor;
+            double error = fabs(since - round(since / interval) * interval);
+            stats->phase_samples++;
+            stats->phase_sum += error;
+            stats->phase_max = MAX(stats->phase_max, error);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ScheduleSettings settings = {.hz = SCHEDULE_DEFAULT_HZ, .seconds = TRUE};
+    int hz = 0;
+    gboolean railway = FALSE, norailway = FALSE, seconds = FALSE, noseconds = FALSE, show_version = FALSE;
+    double start_second = 0.0;
+    int min_redraws = -1, max_redraws = -1, max_wakeups = -1, min_resumes = -1;
+    double max_phase_error = -1.0;
+    GError *error = NULL;
+    GOptionEntry entries[] = {
+        {"hz", 'z', 0, G_OPTION_ARG_INT, &hz, "Refresh rate (hz), else the trace's or 10", "HZ"},
+        {"railway", 'r', 0, G_OPTION_ARG_NONE, &railway, "Swiss railway stop-to-go hands", NULL},
+        {"norailway", 'R', 0, G_OPTION_ARG_NONE, &norailway, "Continuously moving hands", NULL},
+        {"noseconds", 'n', 0, G_OPTION_ARG_NONE, &noseconds, "No second hand", NULL},
+        {"seconds", 'S', 0, G_OPTION_ARG_NONE, &seconds, "Second hand shown", NULL},
+        {"start-second", 0, 0, G_OPTION_ARG_DOUBLE, &start_second,
+         "Second of the minute at the first frame, for traces without wall-clock times", "S"},
+        {"min-redraws", 0, 0, G_OPTION_ARG_INT, &min_redraws, "Fail with fewer redraws", "N"},
+        {"max-redraws", 0, 0, G_OPTION_ARG_INT, &max_redraws, "Fail with more redraws", "N"},
+        {"max-wakeups", 0, 0, G_OPTION_ARG_INT, &max_wakeups, "Fail with more wakeups", "N"},
+        {"min-resumes", 0, 0, G_OPTION_ARG_INT, &min_resumes, "Fail with fewer timer resumes after resting", "N"},
+        {"max-phase-error", 0, 0, G_OPTION_ARG_DOUBLE, &max_phase_error, "Fail with a larger phase error", "MS"},
+        {"version", 'v', 0, G_OPTION_ARG_NONE, &show_version, "Show application version and exit", NULL},
+        {NULL}
+    };
+
+    GOptionContext *context = g_option_context_new("TRACE - Replay a frame-clock trace into the clok4 scheduler");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("Option parsing failed: %s\n", error->message);
+        g_clear_error(&error);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (show_version) {
+        g_print("clok4-trace-replay version %s\n", PROJECT_VERSION);
+        return 0;
+    }
+    if (argc != 2) {
+        g_printerr("Usage: %s [OPTION...] TRACE\n", argv[0]);
+        return 2;
+    }
+    if (hz < 0 || hz > 240 || start_second < 0.0 || start_second >= 60.0) {
+        g_printerr("Invalid refresh rate or start second\n");
+        return 2;
+    }
+
+    gboolean has_settings = FALSE;
+    GArray *frames = load_trace(argv[1], (gint64)(start_second * G_USEC_PER_SEC), &settings, &has_settings, &error);
+    if (!frames) {
+        g_printerr("Cannot read trace: %s\n", error->message);
+        g_clear_error(&error);
+        return 2;
+    }
+    if (!frames->len) {
+        g_printerr("%s has no frames\n", argv[1]);
+        g_array_unref(frames);
+        return 2;
+    }
+    // Options given override the recorded settings
+    if (hz)
+        settings.hz = hz;
+    if (railway || norailway)
+        settings.railway = railway;
+    if (seconds || noseconds)
+        settings.seconds = seconds;
+
+    ReplayStats stats;
+    replay(frames, &settings, &stats);
+
+    const TraceFrame *first = &g_array_index(frames, TraceFrame, 0);
+    const TraceFrame *last = &g_array_index(frames, TraceFrame, frames->len - 1);
+    double duration = (last->frame_time - first->frame_time) / (double)G_USEC_PER_SEC;
+    guint wakeups = stats.ticks + stats.resumes;
+    double phase_mean = stats.phase_samples ? stats.phase_sum / stats.phase_samples : 0.0;
+
+    g_print("Trace %s: %u frames over %.3f s%s\n", argv[1], frames->len, duration,
+            has_settings ? ", recorded settings" : "");
+    g_print("  redraws      %u (%u with the hands), %.2f per second at %d hz%s%s\n", stats.redraws,
+            stats.hand_redraws, duration > 0 ? stats.redraws / duration : 0.0, settings.hz,
+            settings.railway ? " railway" : "", settings.seconds ? "" : " no seconds");
+    g_print("  skipped      %u ticks drew nothing, %u frames while resting\n", stats.skipped, stats.rested);
+    g_print("  wakeups      %u (%u ticks, %u timer resumes)\n", wakeups, stats.ticks, stats.resumes);
+    g_print("  phase error  mean %.3f ms, max %.3f ms over %u sweeping redraws\n", phase_mean / 1000.0,
+            stats.phase_max / 1000.0, stats.phase_samples);
+
+    guint failed = 0;
+    if (min_redraws >= 0 && stats.redraws < (guint)min_redraws) {
+        g_print("! %u redraws, expected at least %d\n", stats.redraws, min_redraws);
+        failed++;
+    }
+    if (max_redraws >= 0 && stats.redraws > (guint)max_redraws) {
+        g_print("! %u redraws, expected at most %d\n", stats.redraws, max_redraws);
+        failed++;
+    }
+    if (min_resumes >= 0 && stats.resumes < (guint)min_resumes) {
+        g_print("! %u timer resumes, expected at least %d\n", stats.resumes, min_resumes);
+        failed++;
+    }
+    if (max_wakeups >= 0 && wakeups > (guint)max_wakeups) {
+        g_print("! %u wakeups, expected at most %d\n", wakeups, max_wakeups);
+        failed++;
+    }
+    if (max_phase_error >= 0.0 && stats.phase_max / 1000.0 > max_phase_error) {
+        g_print("! phase error %.3f ms, expected at most %.3f ms\n", stats.phase_max / 1000.0, max_phase_error);
+        failed++;
+    }
+
+    g_array_unref(frames);
+    return failed ? 1 : 0;
+}
@@ -4,16 +4,30 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
 #include <gtk/gtk.h>
 #include <librsvg/rsvg.h>
+#include <pango/pangocairo.h>
 
 #include "config.h"
+#include "scheduler.h"
+#include "theme.h"
 
 // GTK4 clock using Cairo, based on GTK2 cairo-clock by Mirco "MacSlow" Müller (2006)
 // Copyright 2025 Sami Farin
 //
 // Themes are compatible, but:
-//   INSTALL and theme.conf are ignored
+//   INSTALL and theme.conf are ignored; an optional clok4-manifest.conf gives per-layer rendering hints
 //   configuration files are saved to ~/.config/clok4/clok4.conf
 //   -u option specifies that ~/.config/clok4/themes is searched for themes instead of /usr/share/clok4
 
@@ -24,336 +38,4702 @@
 #define SHADOW_OFFSET_X (-0.75)
 #define SHADOW_OFFSET_Y 0.75
 
+static RsvgHandle *g_svg_handles[CLOCK_ELEMENTS];
+static int clock_width = 400, clock_height = 400;  // window size (config file / command line)
+static int theme_width = 100, theme_height = 100;  // theme canvas size (SVG intrinsic size)
+static int resized_width, resized_height;
+static gboolean size_saved;
+static gchar *theme;
+static int refresh_rate = SCHEDULE_DEFAULT_HZ;
+static gboolean userthemes;
+static gboolean dont_show_seconds;
+static gboolean railway_mode;
+static gboolean motion_blur;
+static gboolean chronograph_mode;
+static gchar *complications;  // comma-separated complication names
+static gchar *timezone2;      // zone identifier for the second-timezone hand
+static gchar **alarm_times;   // daily alarms as HH:MM
+static int countdown_seconds;
+static gchar *night_hours;    // night mode as HH:MM-HH:MM
+static gchar *tint_color;     // accent tint for the hands
+static GtkWidget *g_window = NULL;
+static gboolean all_monitors;  // a fullscreen clock on every monitor
+static GPtrArray *monitor_windows;
+static GTimer *g_clock_timer = NULL;
+static GKeyFile *key_file;
+static gchar *config_file;
+static gchar *config_dir;
+static char *themesystem = "/usr/share/clok4";
+
+// How a layer moves
+typedef enum {
+    TRANSFORM_STATIC = 0,
+    TRANSFORM_HOUR,
+    TRANSFORM_MINUTE,
+    TRANSFORM_SECOND,
+} LayerTransform;
+
+typedef struct {
+    LayerElement source;
+    LayerTransform transform;
+    double offset_x, offset_y;  // theme units, applied before rotation
+    RsvgRectangle ink;          // ink extents of the sprite in theme units, if has_ink
+    gboolean has_ink;
+    int derive_from;            // index of the hand layer in the same pass this shadow copies, or -1
+} RenderLayer;
+
+typedef enum {
+    PASS_CACHED,    // run of static layers, cached as one texture
+    PASS_DYNAMIC,   // run of moving layers, one retained node
+    PASS_OVERLAYS,  // complications, subdials and alarm indicators
+} PassKind;
+
+// Rasterization quality of a cached pass. Renders replaced within moments,
+// such as those made while the window is being resized, use fast settings at
+// reduced resolution; textures kept until the next resize or theme change use
+// the best settings, see --quality
+typedef enum {
+    QUALITY_FAST,
+    QUALITY_BEST,
+} RenderQuality;
+
+// Second hand pre-blurred over one redraw interval (--motion-blur)
+typedef struct {
+    GdkTexture *texture;
+    graphene_rect_t bounds;  // widget space, hand at 12 o'clock
+    int width, height, scale;
+    gint64 interval;  // usec
+} BlurSprite;
+
+typedef struct {
+    PassKind kind;
+    RenderLayer layers[CLOCK_ELEMENTS];
+    size_t n_layers;
+    GdkTexture *texture;    // PASS_CACHED
+    RenderQuality quality;  // PASS_CACHED, quality the texture was rendered at
+    gboolean rasters_waiting;  // PASS_CACHED, last render awaited raster assets being decoded
+    GskRenderNode *node;    // PASS_CACHED texture node, PASS_DYNAMIC container of layer_nodes
+    int node_w, node_h;
+    GskRenderNode *layer_nodes[CLOCK_ELEMENTS];  // PASS_DYNAMIC, each at its layer_angles
+    double layer_angles[CLOCK_ELEMENTS];
+    gboolean layer_blurred[CLOCK_ELEMENTS];   // PASS_DYNAMIC, layer node drawn from blur_sprites
+    BlurSprite blur_sprites[CLOCK_ELEMENTS];
+    GskRenderNode *prepared_nodes[CLOCK_ELEMENTS];  // PASS_DYNAMIC, rendered ahead at prepared_angles
+    double prepared_angles[CLOCK_ELEMENTS];
+    int prepared_w, prepared_h, prepared_scale;
+} RenderPass;
+
+// Overlays drawn for one view: a complication's texture, kept until its content
+// changes, and a chronograph subdial's ring and hand, baked once per size, with
+// the retained node showing them until the hand moves
+#define N_COMPLICATIONS   5
+#define N_CHRONO_SUBDIALS 3
+
+typedef struct {
+    GdkTexture *texture;
+    graphene_rect_t rect;  // where the texture goes, in widget coordinates
+    gint64 next_change;
+    int w, h, scale;
+} ComplicationTexture;
+
+typedef struct {
+    GdkTexture *ring;        // ring and ticks
+    GdkTexture *hand;        // hand at 12 o'clock, rotated by GSK
+    graphene_rect_t bounds;  // of both textures, in widget coordinates
+    int w, h, scale;
+    GskRenderNode *ring_node;
+    GskRenderNode *node;  // ring and hand at value
+    gint64 value;         // stopwatch value the node shows
+} SubdialNode;
+
+// One clock window: its layer graph, built at theme-load time from the layers
+// the theme provides, with the cached textures and retained nodes for its
+// size, and the scheduler driven by its frame clock. With the default layout
+// the graph is face, overlays, hands, glass, like in the original cairo-clock.
+// Retained dynamic nodes let redraws for the overlays alone reuse them, so GSK
+// limits the damage to the overlays. The theme itself is shared by all views;
+// there is one per monitor with --all-monitors, otherwise only main_view
+typedef struct {
+    GtkWidget *widget;    // NULL for headless output
+    GdkMonitor *monitor;  // --all-monitors, NULL for the main window
+    RenderPass passes[CLOCK_ELEMENTS + 1];
+    size_t n_passes;
+    guint generation;  // build_render_passes() run the passes come from
+    int cache_w, cache_h, cache_scale;
+    gboolean hands_dirty;
+    ClockScheduler scheduler;
+    guint tick_id;
+    guint resume_id;
+    guint cache_settle_id;
+    guint prepare_id;
+    ComplicationTexture complications[N_COMPLICATIONS];
+    SubdialNode subdials[N_CHRONO_SUBDIALS];
+} ClockView;
+
+static ClockView main_view = {.hands_dirty = TRUE};
+static GPtrArray *clock_views;  // live views, main_view first if it is used
+static guint pass_generation;
+
+// Redraw every clock window; with hands, rebuild their hand nodes too
+static void queue_draw_views(gboolean hands) {
+    for (guint v = 0; v < clock_views->len; v++) {
+        ClockView *view = g_ptr_array_index(clock_views, v);
+        view->hands_dirty |= hands;
+        if (view->widget)
+            gtk_widget_queue_draw(view->widget);
+    }
+}
+
+// --quality: auto renders fast while resizing and best once the size has
+// settled for CACHE_SETTLE_MS; fast and best use one tier throughout
+#define CACHE_SETTLE_MS 300
+static gchar *render_quality;
+static RenderQuality baked_quality = QUALITY_BEST;
+static RenderQuality resize_quality = QUALITY_FAST;
+
+// Retained nodes handed to GSK again unchanged versus rebuilt
+static struct {
+    guint64 built;
+    guint64 reused;
+    guint64 prepared;  // built ahead of time, then swapped in
+} node_stats;
+
+// Live counters for the metrics socket and D-Bus properties
+typedef struct {
+    guint64 hits, misses, evictions;
+} CacheSizeStats;
+
+static struct {
+    guint64 frames_drawn;
+    guint64 frames_skipped;  // frame clock ticks that drew nothing
+    guint64 wakeups;         // tick callbacks and timer resumes
+    guint64 cache_rebuilds;
+    gint64 cache_rebuild_usec;
+    gint64 last_rebuild_usec;
+    GHashTable *cache_sizes;  // "WxH" in device pixels -> CacheSizeStats
+    const char *strategy;     // sweep, burst, still or resting
+    gint64 hz_window_start;
+    guint hz_window_frames;
+    double effective_hz;
+} metrics = {.strategy = "resting"};
+static gchar *metrics_socket;  // path of the metrics socket, NULL for none
+
+static CacheSizeStats *cache_size_stats(int device_w, int device_h) {
+    if (!metrics.cache_sizes)
+        metrics.cache_sizes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    gchar *key = g_strdup_printf("%dx%d", device_w, device_h);
+    CacheSizeStats *stats = g_hash_table_lookup(metrics.cache_sizes, key);
+    if (!stats) {
+        stats = g_new0(CacheSizeStats, 1);
+        g_hash_table_insert(metrics.cache_sizes, g_steal_pointer(&key), stats);
+    }
+    g_free(key);
+    return stats;
+}
+
+// --startup-report: monotonic timestamps of the startup phases, reported once
+// the first frame has been presented; as text on stderr, or as JSON when a
+// file is given ("-" for stdout)
+typedef struct {
+    const char *phase;
+    gchar *detail;
+    gint64 usec;
+} StartupMark;
+
+static GArray *startup_marks;        // NULL unless a report was requested
+static gboolean startup_report;
+static gchar *startup_report_file;   // JSON output, NULL for text
+static gint64 startup_frame_counter;
+static ClockView *startup_view;      // the first window's, whose first frame ends the report
+
+static void startup_mark_at(const char *phase, const char *detail, gint64 usec) {
+    if (!startup_marks)
+        return;
+    StartupMark mark = {phase, g_strdup(detail), usec};
+    g_array_append_val(startup_marks, mark);
+}
+
+static void startup_mark(const char *phase, const char *detail) {
+    startup_mark_at(phase, detail, g_get_monotonic_time());
+}
+
+// Monotonic time at which the process was started, from its start time in
+// /proc/self/stat; now if that cannot be read
+static gint64 process_start_time(void) {
+    gint64 now = g_get_monotonic_time();
+    gint64 result = now;
+    gchar *stat;
+
+    if (g_file_get_contents("/proc/self/stat", &stat, NULL, NULL)) {
+        // Fields counted from the one after the command name, which may contain spaces
+        const char *end = strrchr(stat, ')');
+        gchar **fields = end ? g_strsplit(end + 2, " ", 0) : NULL;
+        struct timespec boot;
+        if (fields && g_strv_length(fields) > 19 && clock_gettime(CLOCK_BOOTTIME, &boot) == 0) {
+            gint64 started = g_ascii_strtoll(fields[19], NULL, 10) * G_USEC_PER_SEC / sysconf(_SC_CLK_TCK);
+            result = now - ((gint64)boot.tv_sec * G_USEC_PER_SEC + boot.tv_nsec / 1000 - started);
+        }
+        g_strfreev(fields);
+        g_free(stat);
+    }
+    return result;
+}
+
+static void startup_report_finish(void) {
+    if (!startup_marks)
+        return;
+
+    const StartupMark *marks = (const StartupMark *)startup_marks->data;
+    GString *out = g_string_new(NULL);
+    gint64 t0 = marks[0].usec;
+
+    if (startup_report_file) {
+        g_string_append(out, "{\n  \"phases\": [\n");
+        for (guint i = 0; i < startup_marks->len; i++) {
+            gchar *detail = marks[i].detail ? g_strescape(marks[i].detail, NULL) : NULL;
+            g_string_append_printf(out, "    {\"phase\": \"%s\", ", marks[i].phase);
+            if (detail)
+                g_string_append_printf(out, "\"detail\": \"%s\", ", detail);
+            g_string_append_printf(out, "\"ms\": %.3f}%s\n", (marks[i].usec - t0) / 1000.0,
+                                   i + 1 < startup_marks->len ? "," : "");
+            g_free(detail);
+        }
+        g_string_append(out, "  ]\n}\n");
+    } else {
+        g_string_append(out, "Startup phases, ms since process start:\n");
+        for (guint i = 0; i < startup_marks->len; i++) {
+            gint64 step = i ? marks[i].usec - marks[i - 1].usec : 0;
+            g_string_append_printf(out, "  %-18s %-28s %9.1f  +%.1f\n", marks[i].phase,
+                                   marks[i].detail ? marks[i].detail : "", (marks[i].usec - t0) / 1000.0,
+                                   step / 1000.0);
+        }
+    }
+
+    GError *err = NULL;
+    if (!startup_report_file) {
+        g_printerr("%s", out->str);
+    } else if (!strcmp(startup_report_file, "-")) {
+        g_print("%s", out->str);
+    } else if (!g_file_set_contents(startup_report_file, out->str, out->len, &err)) {
+        g_printerr("Cannot write startup report: %s\n", err->message);
+        g_clear_error(&err);
+    }
+    g_string_free(out, TRUE);
+
+    for (guint i = 0; i < startup_marks->len; i++) {
+        g_free(marks[i].detail);
+    }
+    g_clear_pointer(&startup_marks, g_array_unref);
+}
+
+// The first frame counts once the frame clock has its presentation time
+static void on_startup_after_paint(GdkFrameClock *frame_clock, gpointer user_data) {
+    GdkFrameTimings *timings = gdk_frame_clock_get_timings(frame_clock, startup_frame_counter);
+    if (timings && !gdk_frame_timings_get_complete(timings))
+        return;
+
+    gint64 presented = timings ? gdk_frame_timings_get_presentation_time(timings) : 0;
+    if (presented)
+        startup_mark_at("first-frame", "presented", presented);
+    else
+        startup_mark("first-frame", "painted, no presentation time");
+    g_signal_handlers_disconnect_by_func(frame_clock, on_startup_after_paint, NULL);
+    startup_report_finish();
+}
+
+static void startup_first_snapshot(GtkWidget *widget) {
+    GdkFrameClock *frame_clock = gtk_widget_get_frame_clock(widget);
+    startup_mark("first-snapshot", NULL);
+    if (!frame_clock) {
+        startup_report_finish();
+        return;
+    }
+    startup_frame_counter = gdk_frame_clock_get_frame_counter(frame_clock);
+    g_signal_connect(frame_clock, "after-paint", G_CALLBACK(on_startup_after_paint), NULL);
+}
+
+static gboolean on_startup_report_option(const gchar *option_name, const gchar *value, gpointer data,
+                                         GError **error) {
+    startup_report = TRUE;
+    g_free(startup_report_file);
+    startup_report_file = g_strdup(value);
+    return TRUE;
+}
+
+static void on_app_startup(GApplication *app, gpointer user_data) {
+    startup_mark("gtk-init", NULL);
+}
+
+// Forward declarations
+#define CLOCK_TYPE_WIDGET (clock_widget_get_type())
+G_DECLARE_FINAL_TYPE(ClockWidget, clock_widget, CLOCK, WIDGET, GtkWidget)
+
+struct _ClockWidget {
+    GtkWidget parent_instance;
+    ClockView *view;
+};
+
+G_DEFINE_TYPE(ClockWidget, clock_widget, GTK_TYPE_WIDGET)
+
+#define LAYER_BIT(e) (1u << (e))
+
+// Drawing order of the theme layers; LAYER_OVERLAYS is where complications,
+// chronograph subdials and alarm indicators go
+#define LAYER_OVERLAYS CLOCK_ELEMENTS
+static const int layer_order[] = {
+    CLOCK_DROP_SHADOW,      CLOCK_FACE,        CLOCK_MARKS,              LAYER_OVERLAYS,
+    CLOCK_HOUR_HAND_SHADOW, CLOCK_MINUTE_HAND_SHADOW, CLOCK_SECOND_HAND_SHADOW,
+    CLOCK_HOUR_HAND,        CLOCK_MINUTE_HAND, CLOCK_SECOND_HAND,
+    CLOCK_FACE_SHADOW,      CLOCK_GLASS,       CLOCK_FRAME,
+};
+
+// Whether the current settings draw layer e at all
+static gboolean layer_wanted(LayerElement e) {
+    switch (e) {
+    case CLOCK_SECOND_HAND:
+    case CLOCK_SECOND_HAND_SHADOW:
+        return !dont_show_seconds;
+    case CLOCK_CHRONO_SECONDS_HAND:
+    case CLOCK_CHRONO_MINUTES_HAND:
+    case CLOCK_CHRONO_TENTHS_HAND:
+        return chronograph_mode;
+    default:
+        return TRUE;
+    }
+}
+
+// Optional per-theme manifest (GKeyFile) with rendering hints, one group per
+// layer named like its file without .svg:
+//   [clock-marks]
+//   kind=static            static or dynamic
+//   symmetry=60            rotational symmetry order, render one wedge and replicate
+//   min-size=1024          rasterize at least this many pixels wide
+//   [clock-hour-hand]
+//   pivot=0;0              rotation pivot in theme units
+//   transform=hour         static, hour, minute or second
+//   [clock-hour-hand-shadow]
+//   shadow-of=clock-hour-hand
+//   shadow-color=rgba(0,0,0,0.4)   shadow is a tinted, offset copy of the hand
+//   shadow-blur=0.5        blur radius of a derived shadow in theme units
+// A hand shadow without an SVG of its own is derived from its hand as well
+#define THEME_MANIFEST "clok4-manifest.conf"
+
+typedef struct {
+    int dynamic;     // -1 unset, else whether the layer moves
+    int transform;   // LayerTransform, -1 for the layer's default
+    double pivot_x, pivot_y;
+    int symmetry;    // 0 or 1 for none
+    int shadow_of;   // LayerElement the shadow is derived from, -1 if it has its own SVG
+    GdkRGBA shadow_color;
+    double shadow_blur;  // theme units
+    int min_size;    // minimum raster width in device pixels, 0 for none
+} LayerHints;
+
+static LayerHints layer_hints[CLOCK_ELEMENTS];
+static gboolean check_hints;
+
+// Static layers may ship pre-rendered raster assets (FILE@SIZE.png or .webp)
+// alongside or instead of their SVG; when they do, the SVG is not parsed at
+// all. The asset picked for the current raster size is decoded on a worker
+// thread, and released again once the cached pass drawing it is rendered
+typedef struct {
+    GPtrArray *assets;         // ThemeRaster, smallest first; NULL for none
+    const ThemeRaster *loaded;  // asset decoded into surface
+    cairo_surface_t *surface;
+    const ThemeRaster *decoding;  // asset being decoded off the main thread
+    guint serial;               // bumped when assets change, so stale decodes are dropped
+} LayerRaster;
+
+static LayerRaster layer_rasters[CLOCK_ELEMENTS];
+
+static void layer_raster_clear(LayerRaster *raster) {
+    g_clear_pointer(&raster->surface, cairo_surface_destroy);
+    g_clear_pointer(&raster->assets, g_ptr_array_unref);
+    raster->loaded = NULL;
+    raster->decoding = NULL;
+    raster->serial++;
+}
+
+static LayerTransform default_layer_transform(LayerElement e) {
+    switch (e) {
+    case CLOCK_HOUR_HAND:
+    case CLOCK_HOUR_HAND_SHADOW:
+        return TRANSFORM_HOUR;
+    case CLOCK_MINUTE_HAND:
+    case CLOCK_MINUTE_HAND_SHADOW:
+        return TRANSFORM_MINUTE;
+    case CLOCK_SECOND_HAND:
+    case CLOCK_SECOND_HAND_SHADOW:
+        return TRANSFORM_SECOND;
+    default:
+        return TRANSFORM_STATIC;
+    }
+}
+
+// Transform of layer e, as the manifest hints h override it
+static LayerTransform hints_transform(LayerElement e, const LayerHints *h) {
+    if (h->transform >= 0)
+        return h->transform;
+    if (h->dynamic == 0)
+        return TRANSFORM_STATIC;
+    return default_layer_transform(e);
+}
+
+static LayerTransform layer_transform(LayerElement e) {
+    return hints_transform(e, &layer_hints[e]);
+}
+
+// Whether layer e has anything to draw: its own SVG, raster assets for a static
+// layer, or a hand to derive it from
+static gboolean layer_present(LayerElement e) {
+    int source = layer_hints[e].shadow_of;
+    return g_svg_handles[e] || (layer_rasters[e].assets && layer_transform(e) == TRANSFORM_STATIC) ||
+           (source >= 0 && g_svg_handles[source]);
+}
+
+// Layer whose file is name + ".svg", or -1
+static int layer_by_name(const char *name) {
+    size_t len = strlen(name);
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if (!strncmp(layer_files[e].file, name, len) && !strcmp(layer_files[e].file + len, ".svg"))
+            return e;
+    }
+    return -1;
+}
+
+static void layer_hints_init(LayerHints hints[CLOCK_ELEMENTS]) {
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        hints[e] = (LayerHints){.dynamic = -1, .transform = -1, .shadow_of = -1};
+        gdk_rgba_parse(&hints[e].shadow_color, "rgba(0,0,0,0.4)");
+    }
+}
+
+static gboolean layer_hints_equal(const LayerHints *a, const LayerHints *b) {
+    return a->dynamic == b->dynamic && a->transform == b->transform && a->pivot_x == b->pivot_x &&
+           a->pivot_y == b->pivot_y && a->symmetry == b->symmetry && a->shadow_of == b->shadow_of &&
+           gdk_rgba_equal(&a->shadow_color, &b->shadow_color) && a->shadow_blur == b->shadow_blur &&
+           a->min_size == b->min_size;
+}
+
+// Read the manifest in dir, if any; safe to call from the theme loader thread
+static void parse_theme_manifest(const char *dir, LayerHints hints[CLOCK_ELEMENTS]) {
+    GError *err = NULL;
+    gchar *path = g_build_filename(dir, THEME_MANIFEST, NULL);
+    GKeyFile *kf = g_key_file_new();
+
+    layer_hints_init(hints);
+    if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, &err)) {
+        if (!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_warning("Cannot read theme manifest %s: %s", path, err->message);
+        g_clear_error(&err);
+        g_key_file_free(kf);
+        g_free(path);
+        return;
+    }
+
+    gchar **groups = g_key_file_get_groups(kf, NULL);
+    for (gchar **group = groups; *group; group++) {
+        int e = layer_by_name(*group);
+        if (e < 0) {
+            g_warning("%s: unknown layer [%s]", path, *group);
+            continue;
+        }
+        LayerHints *h = &hints[e];
+
+        gchar *kind = g_key_file_get_string(kf, *group, "kind", NULL);
+        if (kind)
+            h->dynamic = !strcmp(kind, "dynamic");
+        g_free(kind);
+
+        static const char *const transforms[] = {"static", "hour", "minute", "second"};
+        gchar *transform = g_key_file_get_string(kf, *group, "transform", NULL);
+        for (int t = 0; transform && t < (int)G_N_ELEMENTS(transforms); t++) {
+            if (!strcmp(transform, transforms[t]))
+                h->transform = t;
+        }
+        if (transform && h->transform < 0)
+            g_warning("%s: [%s] unknown transform %s", path, *group, transform);
+        g_free(transform);
+
+        gsize n_pivot = 0;
+        gdouble *pivot = g_key_file_get_double_list(kf, *group, "pivot", &n_pivot, NULL);
+        if (pivot && n_pivot == 2) {
+            h->pivot_x = pivot[0];
+            h->pivot_y = pivot[1];
+        }
+        g_free(pivot);
+
+        h->symmetry = CLAMP(g_key_file_get_integer(kf, *group, "symmetry", NULL), 0, 360);
+        h->min_size = CLAMP(g_key_file_get_integer(kf, *group, "min-size", NULL), 0, 8192);
+
+        gchar *source = g_key_file_get_string(kf, *group, "shadow-of", NULL);
+        if (source) {
+            int s = layer_by_name(source);
+            if (layer_is_shadow(e) && s >= 0 && layer_is_dynamic(s) && !layer_is_shadow(s))
+                h->shadow_of = s;
+            else
+                g_warning("%s: [%s] cannot be a shadow of %s", path, *group, source);
+        }
+        g_free(source);
+
+        gchar *color = g_key_file_get_string(kf, *group, "shadow-color", NULL);
+        if (color && !gdk_rgba_parse(&h->shadow_color, color))
+            g_warning("%s: [%s] invalid shadow-color %s", path, *group, color);
+        g_free(color);
+
+        if (g_key_file_has_key(kf, *group, "shadow-blur", NULL))
+            h->shadow_blur = MAX(g_key_file_get_double(kf, *group, "shadow-blur", NULL), 0.0);
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(kf);
+    g_free(path);
+}
+
+static gchar *theme_dir_path(const char *theme_name, gboolean user) {
+    return g_build_path(G_DIR_SEPARATOR_S, user ? config_dir : themesystem, "themes", theme_name, NULL);
+}
+
+static RsvgHandle *load_svg(const char *filename, gboolean needed) {
+    GError *err = NULL;
+    char *dir = theme_dir_path(theme, userthemes);
+    char *full = g_build_filename(dir, filename, NULL);
+    RsvgHandle *h = theme_load_svg(dir, filename, &err);
+    if (!h) {
+        gchar errstring[4096];
+        g_snprintf(errstring, sizeof(errstring), "[%s] Cannot load SVG from %s: %s", needed ? "ERROR" : "WARNING", full,
+                   err ? err->message : "unknown error");
+        g_warning("%s", errstring);
+        g_clear_error(&err);
+        if (needed)
+            exit(EXIT_FAILURE);
+    }
+    g_free(full);
+    g_free(dir);
+    return h;
+}
+
+// Theme canvas size from the intrinsic size of theme_canvas_svg(); keeps the
+// 100x100 cairo-clock default if the SVG has no usable intrinsic size
+static void update_theme_size(RsvgHandle *canvas) {
+    gdouble w = 0.0, h = 0.0;
+    if (!canvas)
+        return;
+    if (rsvg_handle_get_intrinsic_size_in_pixels(canvas, &w, &h) && w >= 1.0 && h >= 1.0) {
+        theme_width = (int)ceil(w);
+        theme_height = (int)ceil(h);
+    } else {
+        g_warning("Theme canvas has no usable intrinsic size, assuming %dx%d", theme_width, theme_height);
+    }
+}
+
+// SVG giving the theme canvas size: the drop shadow, or the hour hand when the
+// drop shadow comes as raster assets only
+static RsvgHandle *theme_canvas_svg(RsvgHandle *const handles[CLOCK_ELEMENTS]) {
+    return handles[CLOCK_DROP_SHADOW] ? handles[CLOCK_DROP_SHADOW] : handles[CLOCK_HOUR_HAND];
+}
+
+// Hand shadows the theme ships no SVG for are derived from their hand
+static void derive_missing_shadows(RsvgHandle *const handles[CLOCK_ELEMENTS], LayerHints hints[CLOCK_ELEMENTS]) {
+    for (int e = CLOCK_HOUR_HAND_SHADOW; e <= CLOCK_SECOND_HAND_SHADOW; e++) {
+        int hand = e + CLOCK_HOUR_HAND - CLOCK_HOUR_HAND_SHADOW;
+        if (hints[e].shadow_of < 0 && !handles[e] && handles[hand])
+            hints[e].shadow_of = hand;
+    }
+}
+
+// Load SVGs once; called from activate so a broken theme fails before the window is shown
+static void load_all_svgs(void) {
+    static gboolean svgs_loaded = FALSE;
+    if (svgs_loaded)
+        return;
+
+    gchar *dir = theme_dir_path(theme, userthemes);
+    parse_theme_manifest(dir, layer_hints);
+
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        // Shadows the manifest derives from their hand need no SVG of their own
+        if (!layer_wanted(e) || layer_hints[e].shadow_of >= 0)
+            continue;
+        if (layer_transform(e) == TRANSFORM_STATIC)
+            layer_rasters[e].assets = theme_find_rasters(dir, layer_files[e].file);
+        if (layer_rasters[e].assets) {
+            startup_mark("find-rasters", layer_files[e].file);
+        } else {
+            g_svg_handles[e] = load_svg(layer_files[e].file, layer_files[e].needed);
+            startup_mark("load-svg", layer_files[e].file);
+        }
+    }
+    g_free(dir);
+
+    derive_missing_shadows(g_svg_handles, layer_hints);
+    update_theme_size(theme_canvas_svg(g_svg_handles));
+
+    svgs_loaded = TRUE;
+}
+
+// Hand angles in radians, clockwise from 12
+typedef struct {
+    double hour;
+    double minute;
+    double second;
+} HandAngles;
+
+static double ease_out_cubic(double t) {
+    double u = 1.0 - t;
+    return 1.0 - u * u * u;
+}
+
+static void compute_hand_angles(const struct timespec *ts, HandAngles *angles) {
+    struct tm tm;
+    time_t time_sec = ts->tv_sec;
+    localtime_r(&time_sec, &tm);
+
+    double second = tm.tm_sec + ((double)ts->tv_nsec / 1e9);
+    double minute, angle_second;
+
+    if (railway_mode) {
+        angle_second = MIN(second / RAILWAY_SWEEP_SECONDS, 1.0) * 360.0;
+        minute = tm.tm_min;
+        if (second < RAILWAY_JUMP_SECONDS)
+            minute += ease_out_cubic(second / RAILWAY_JUMP_SECONDS) - 1.0;
+    } else {
+        angle_second = second * 6.0;
+        minute = tm.tm_min + second / 60.0;
+    }
+
+    double angle_hour = (tm.tm_hour % 12) * 30.0 + minute * 0.5;
+    double angle_minute = minute * 6.0;
+
+    angles->hour = angle_hour * (M_PI / 180.0);
+    angles->minute = angle_minute * (M_PI / 180.0);
+    angles->second = angle_second * (M_PI / 180.0);
+}
+
+// Chronograph subdials refresh at up to this rate while the stopwatch runs
+#define CHRONO_HZ 240
+
+static ScheduleSettings schedule_settings(void) {
+    return (ScheduleSettings){.hz = refresh_rate, .railway = railway_mode, .seconds = !dont_show_seconds};
+}
+
+// Stopwatch on the monotonic clock, so setting the wall clock does not disturb it
+static struct {
+    gboolean running;
+    gint64 started;      // monotonic time of the last start
+    gint64 accumulated;  // elapsed time before the last start
+} stopwatch;
+
+static gint64 stopwatch_elapsed(void) {
+    return stopwatch.accumulated + (stopwatch.running ? g_get_monotonic_time() - stopwatch.started : 0);
+}
+
+// Alarm indication: the face flashes for ALARM_FLASH_SECONDS or until dismissed,
+// animated at ALARM_FLASH_HZ; running countdowns show a progress arc
+#define ALARM_FLASH_SECONDS 60
+#define ALARM_FLASH_HZ      30
+
+typedef enum {
+    ALARM_DAILY,
+    ALARM_COUNTDOWN,
+} AlarmKind;
+
+// Alarms are absolute CLOCK_REALTIME timerfds watched by the main loop, so
+// nothing polls while waiting and wall-clock steps are handled by the kernel
+typedef struct {
+    AlarmKind kind;
+    int hour, minute;    // daily alarm time
+    gint64 start, end;   // countdown, real time in usec
+    int fd;
+    guint source_id;
+} ClockAlarm;
+
+static GPtrArray *clock_alarms = NULL;
+static int countdowns_running;
+static gint64 alarm_flash_until;  // real time in usec, 0 when not flashing
+
+// Night mode dims the face and red-shifts the hands with colour matrices over
+// the cached layers, cross-fading over NIGHT_FADE_SECONDS at dusk and dawn
+#define NIGHT_FADE_SECONDS 5.0
+#define NIGHT_FADE_HZ      30
+
+static int night_start = -1, night_end = -1;  // seconds since local midnight, -1 if unset
+static gboolean night_fading;
+static gboolean tint_enabled;
+static GdkRGBA tint_rgba;
+
+// Night mode strength for realtime ts: 0 by day, 1 at night, in between while fading
+static double night_factor(const struct timespec *ts, gboolean *fading) {
+    *fading = FALSE;
+    if (night_start < 0)
+        return 0.0;
+
+    struct tm tm;
+    time_t time_sec = ts->tv_sec;
+    localtime_r(&time_sec, &tm);
+    double day = 24 * 3600;
+    double now = tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec + ts->tv_nsec / 1e9;
+    double since_start = fmod(now - night_start + day, day);
+    double since_end = fmod(now - night_end + day, day);
+    gboolean night = night_start < night_end ? now >= night_start && now < night_end
+                                               : now >= night_start || now < night_end;
+
+    if (night) {
+        *fading = since_start < NIGHT_FADE_SECONDS;
+        return *fading ? since_start / NIGHT_FADE_SECONDS : 1.0;
+    }
+    *fading = since_end < NIGHT_FADE_SECONDS;
+    return *fading ? 1.0 - since_end / NIGHT_FADE_SECONDS : 0.0;
+}
+
+// Fill a colour matrix from a[out][in]; GSK multiplies the colour as a row vector
+static void color_matrix_init(graphene_matrix_t *m, const float a[4][4]) {
+    float v[16];
+    for (int out = 0; out < 4; out++) {
+        for (int in = 0; in < 4; in++) {
+            v[in * 4 + out] = a[out][in];
+        }
+    }
+    graphene_matrix_init_from_float(m, v);
+}
+
+// Colour matrices for the face and the hands at night strength t with the
+// accent tint; returns FALSE when both are the identity
+static gboolean night_color_matrices(double t, graphene_matrix_t *face, graphene_matrix_t *hands) {
+    if (t <= 0.0 && !tint_enabled)
+        return FALSE;
+
+    // Dimmed face keeps a little more red than green and blue
+    float f[4][4] = {{0}};
+    f[0][0] = 1.0 - t * 0.60;
+    f[1][1] = 1.0 - t * 0.70;
+    f[2][2] = 1.0 - t * 0.75;
+    f[3][3] = 1.0;
+    color_matrix_init(face, f);
+
+    // Hands: accent tint by day, mixed towards red luminance at night
+    float tr = tint_enabled ? tint_rgba.red : 1.0, tg = tint_enabled ? tint_rgba.green : 1.0,
+          tb = tint_enabled ? tint_rgba.blue : 1.0;
+    static const float luma[3] = {0.30f, 0.59f, 0.11f};
+    static const float red_shift[3] = {0.9f, 0.15f, 0.08f};
+    float h[4][4] = {{0}};
+    float tint[3] = {tr, tg, tb};
+    for (int out = 0; out < 3; out++) {
+        for (int in = 0; in < 3; in++) {
+            float day = out == in ? tint[out] : 0.0f;
+            h[out][in] = (1.0 - t) * day + t * red_shift[out] * luma[in];
+        }
+    }
+    h[3][3] = 1.0;
+    color_matrix_init(hands, h);
+    return TRUE;
+}
+
+static int parse_hhmm(const char *s, const char **rest) {
+    int hour, minute, n = 0;
+    if (sscanf(s, "%d:%d%n", &hour, &minute, &n) != 2 || hour < 0 || hour > 23 || minute < 0 || minute > 59)
+        return -1;
+    *rest = s + n;
+    return (hour * 60 + minute) * 60;
+}
+
+static void setup_night_mode(void) {
+    if (night_hours && *night_hours) {
+        const char *rest = night_hours;
+        night_start = parse_hhmm(rest, &rest);
+        night_end = night_start >= 0 && *rest == '-' ? parse_hhmm(rest + 1, &rest) : -1;
+        // Equal times would flash to day brightness at the start every day
+        if (night_start < 0 || night_end < 0 || night_start == night_end || *rest) {
+            g_printerr("Invalid night hours %s, expected HH:MM-HH:MM\n", night_hours);
+            night_start = night_end = -1;
+        }
+    }
+    if (tint_color && *tint_color) {
+        tint_enabled = gdk_rgba_parse(&tint_rgba, tint_color);
+        if (!tint_enabled)
+            g_printerr("Invalid tint colour %s\n", tint_color);
+    }
+}
+
+// Rate needed by overlays animating independently of the hands, 0 if none
+static int overlay_hz(void) {
+    int hz = 0;
+    if (stopwatch.running)
+        hz = CHRONO_HZ;
+    if (alarm_flash_until)
+        hz = MAX(hz, ALARM_FLASH_HZ);
+    if (countdowns_running)
+        hz = MAX(hz, refresh_rate);
+    if (night_fading)
+        hz = MAX(hz, NIGHT_FADE_HZ);
+    return hz;
+}
+
+static gboolean tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data);
+
+static void ensure_view_ticking(ClockView *view) {
+    if (view->widget && !view->tick_id) {
+        clock_scheduler_reset(&view->scheduler);
+        view->tick_id = gtk_widget_add_tick_callback(view->widget, tick, view, NULL);
+    }
+}
+
+static void ensure_ticking(void) {
+    for (guint v = 0; v < clock_views->len; v++) {
+        ensure_view_ticking(g_ptr_array_index(clock_views, v));
+    }
+}
+
+static gboolean resume_ticking(gpointer user_data) {
+    ClockView *view = user_data;
+    view->resume_id = 0;
+    metrics.wakeups++;
+    ensure_view_ticking(view);
+    return G_SOURCE_REMOVE;
+}
+
+// Frame-synced redraw driven by the view's own frame clock, so each monitor is
+// paced to its own refresh; clock_scheduler_step() decides when the hands and
+// the overlays at overlay_hz() are due, this keeps the alarm flash and night
+// fade up to date and applies the decision
+static gboolean tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data) {
+    ClockView *view = user_data;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    metrics.wakeups++;
+
+    if (alarm_flash_until && (gint64)ts.tv_sec * G_USEC_PER_SEC >= alarm_flash_until) {
+        alarm_flash_until = 0;
+        queue_draw_views(TRUE);  // one more frame to clear the flash
+    }
+    gboolean fading;
+    night_factor(&ts, &fading);
+    if (night_fading && !fading)
+        queue_draw_views(TRUE);  // one more frame at the final tint
+    night_fading = fading;
+
+    gint64 now = gdk_frame_clock_get_frame_time(frame_clock);
+    gint64 refresh_interval = 0;
+    gdk_frame_clock_get_refresh_info(frame_clock, now, &refresh_interval, NULL);
+
+    ScheduleSettings settings = schedule_settings();
+    ScheduleDecision decision;
+    clock_scheduler_step(&view->scheduler, &settings, &ts, now, refresh_interval, overlay_hz(), &decision);
+    if (decision.hands)
+        view->hands_dirty = TRUE;
+    metrics.strategy = decision.strategy;
+
+    if (decision.rest_usec) {
+        gtk_widget_queue_draw(widget);
+        view->resume_id = g_timeout_add((guint)((decision.rest_usec + 999) / 1000), resume_ticking, view);
+        view->tick_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    if (view->hands_dirty || decision.overlays) {
+        gtk_widget_queue_draw(widget);
+    } else {
+        metrics.frames_skipped++;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// --record-trace: the frame clock's timeline in the format clok4-trace-replay
+// reads. A frame line is written for every frame clock cycle, a presented line
+// once GDK knows when that frame reached the screen, and an overlay line when
+// the overlay rate changes
+static FILE *trace_file = NULL;
+static gchar *trace_path;
+static gint64 trace_presented_counter;  // last frame counter whose timings were written
+static int trace_overlay_hz;
+
+static void on_trace_after_paint(GdkFrameClock *frame_clock, gpointer user_data) {
+    gint64 now = gdk_frame_clock_get_frame_time(frame_clock);
+    gint64 refresh_interval = 0;
+    gdk_frame_clock_get_refresh_info(frame_clock, now, &refresh_interval, NULL);
+
+    int ohz = overlay_hz();
+    if (ohz != trace_overlay_hz)
+        fprintf(trace_file, "overlay %d\n", ohz);
+    trace_overlay_hz = ohz;
+    fprintf(trace_file, "frame %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n", now,
+            refresh_interval, g_get_real_time());
+
+    // Timings complete a frame or more later, in order
+    gint64 counter = MAX(trace_presented_counter + 1, gdk_frame_clock_get_history_start(frame_clock));
+    for (; counter <= gdk_frame_clock_get_frame_counter(frame_clock); counter++) {
+        GdkFrameTimings *timings = gdk_frame_clock_get_timings(frame_clock, counter);
+        if (!timings || !gdk_frame_timings_get_complete(timings))
+            break;
+        gint64 presented = gdk_frame_timings_get_presentation_time(timings);
+        if (presented)
+            fprintf(trace_file, "presented %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+                    gdk_frame_timings_get_frame_time(timings), presented);
+        trace_presented_counter = counter;
+    }
+}
+
+static void on_trace_realize(GtkWidget *widget, gpointer user_data) {
+    g_signal_connect(gtk_widget_get_frame_clock(widget), "after-paint", G_CALLBACK(on_trace_after_paint), NULL);
+}
+
+// Record the frame clock of widget, the first clock window's; with
+// --all-monitors that is the first monitor's window
+static void start_trace_recording(GtkWidget *widget) {
+    if (!trace_path || trace_file)
+        return;
+    trace_file = g_fopen(trace_path, "w");
+    if (!trace_file) {
+        g_printerr("Cannot write trace %s: %s\n", trace_path, g_strerror(errno));
+        g_clear_pointer(&trace_path, g_free);
+        return;
+    }
+    fprintf(trace_file, "# %s %s frame-clock trace, %d hz%s%s; times in usec\n", APP_NAME, PROJECT_VERSION,
+            refresh_rate, railway_mode ? ", railway" : "", dont_show_seconds ? ", no seconds" : "");
+    g_signal_connect(widget, "realize", G_CALLBACK(on_trace_realize), NULL);
+}
+
+static void alarm_arm(ClockAlarm *alarm) {
+    gint64 target = alarm->end;
+    if (alarm->kind == ALARM_DAILY) {
+        GDateTime *now = g_date_time_new_now_local();
+        GDateTime *at = g_date_time_new(g_date_time_get_timezone(now), g_date_time_get_year(now),
+                                        g_date_time_get_month(now), g_date_time_get_day_of_month(now), alarm->hour,
+                                        alarm->minute, 0);
+        if (g_date_time_compare(at, now) <= 0) {
+            GDateTime *tomorrow = g_date_time_add_days(at, 1);
+            g_date_time_unref(at);
+            at = tomorrow;
+        }
+        target = g_date_time_to_unix(at) * G_USEC_PER_SEC;
+        g_date_time_unref(at);
+        g_date_time_unref(now);
+    }
+
+    // Absolute expiry; CANCEL_ON_SET makes a clock step wake us up to re-arm
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = target / G_USEC_PER_SEC;
+    spec.it_value.tv_nsec = (target % G_USEC_PER_SEC) * 1000;
+    if (timerfd_settime(alarm->fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) == -1) {
+        g_warning("Cannot arm alarm timer: %s", g_strerror(errno));
+    }
+}
+
+static void alarm_fire(void) {
+    alarm_flash_until = g_get_real_time() + ALARM_FLASH_SECONDS * G_USEC_PER_SEC;
+    ensure_ticking();
+}
+
+static void alarm_dismiss(void) {
+    if (alarm_flash_until) {
+        alarm_flash_until = 0;
+        queue_draw_views(TRUE);
+    }
+}
+
+static gboolean on_alarm_timer(gint fd, GIOCondition condition, gpointer user_data) {
+    ClockAlarm *alarm = user_data;
+    guint64 expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) == -1) {
+        if (errno == ECANCELED) {
+            // Wall clock was set: daily alarms move to the new local time,
+            // countdowns fire at once if their end has already passed
+            alarm_arm(alarm);
+        }
+        return G_SOURCE_CONTINUE;
+    }
+
+    alarm_fire();
+    if (alarm->kind == ALARM_DAILY) {
+        alarm_arm(alarm);
+        return G_SOURCE_CONTINUE;
+    }
+
+    countdowns_running--;
+    alarm->source_id = 0;
+    return G_SOURCE_REMOVE;
+}
+
+static void clock_alarm_free(gpointer data) {
+    ClockAlarm *alarm = data;
+    if (alarm->source_id)
+        g_source_remove(alarm->source_id);
+    if (alarm->fd != -1)
+        close(alarm->fd);
+    g_free(alarm);
+}
+
+static void add_alarm(AlarmKind kind, int hour, int minute, gint64 end) {
+    int fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        g_printerr("Cannot create alarm timer: %s\n", g_strerror(errno));
+        return;
+    }
+
+    ClockAlarm *alarm = g_new0(ClockAlarm, 1);
+    alarm->kind = kind;
+    alarm->hour = hour;
+    alarm->minute = minute;
+    alarm->start = g_get_real_time();
+    alarm->end = end;
+    alarm->fd = fd;
+    alarm_arm(alarm);
+    alarm->source_id = g_unix_fd_add(fd, G_IO_IN, on_alarm_timer, alarm);
+    g_ptr_array_add(clock_alarms, alarm);
+    if (kind == ALARM_COUNTDOWN)
+        countdowns_running++;
+}
+
+static void setup_alarms(void) {
+    clock_alarms = g_ptr_array_new_with_free_func(clock_alarm_free);
+
+    for (gchar **t = alarm_times; t && *t; t++) {
+        int hour, minute;
+        char end;
+        if (sscanf(*t, "%d:%d%c", &hour, &minute, &end) != 2 || hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+            g_printerr("Invalid alarm time %s, expected HH:MM\n", *t);
+            continue;
+        }
+        add_alarm(ALARM_DAILY, hour, minute, 0);
+    }
+
+    if (countdown_seconds > 0) {
+        add_alarm(ALARM_COUNTDOWN, 0, 0, g_get_real_time() + (gint64)countdown_seconds * G_USEC_PER_SEC);
+    }
+}
+
+static void load_transparent_css(void) {
+    GtkCssProvider *provider = gtk_css_provider_new();
+    const gchar *css = "window, box, widget { background-color: transparent; }";
+    gtk_css_provider_load_from_string(provider, css);
+    gtk_style_context_add_provider_for_display(gdk_display_get_default(), GTK_STYLE_PROVIDER(provider),
+                                               GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+    g_object_unref(provider);
+}
+
+// Wrap a finished Cairo image surface in a GdkTexture; takes ownership of the surface
+static GdkTexture *texture_from_surface(cairo_surface_t *surface) {
+    // Finish pending drawing before accessing the pixel data directly
+    cairo_surface_flush(surface);
+
+    // Convert Cairo surface to GdkTexture
+    GBytes *bytes =
+        g_bytes_new_with_free_func(cairo_image_surface_get_data(surface),
+                                   cairo_image_surface_get_height(surface) * cairo_image_surface_get_stride(surface),
+                                   (GDestroyNotify)cairo_surface_destroy, surface);
+
+    GdkTexture *texture =
+        gdk_memory_texture_new(cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface),
+                               GDK_MEMORY_DEFAULT, bytes, cairo_image_surface_get_stride(surface));
+
+    g_bytes_unref(bytes);
+    return texture;
+}
+
+// Decode a raster theme asset into a premultiplied ARGB32 surface
+static cairo_surface_t *load_raster(const char *path, GError **error) {
+    GdkTexture *texture = gdk_texture_new_from_filename(path, error);
+    if (!texture)
+        return NULL;
+
+    int w = gdk_texture_get_width(texture), h = gdk_texture_get_height(texture);
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+    gdk_texture_download(texture, cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface));
+    cairo_surface_mark_dirty(surface);
+    g_object_unref(texture);
+    return surface;
+}
+
+// Paint a raster asset stretched over the theme viewport, filtered for quality
+static void paint_raster(cairo_t *cr, cairo_surface_t *surface, const RsvgRectangle *viewport,
+                         RenderQuality quality) {
+    cairo_save(cr);
+    cairo_translate(cr, viewport->x, viewport->y);
+    cairo_scale(cr, viewport->width / cairo_image_surface_get_width(surface),
+                viewport->height / cairo_image_surface_get_height(surface));
+    cairo_set_source_surface(cr, surface, 0.0, 0.0);
+    cairo_pattern_set_filter(cairo_get_source(cr), quality == QUALITY_FAST ? CAIRO_FILTER_GOOD : CAIRO_FILTER_BEST);
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
+
+// Width in device pixels the viewport is drawn at
+static int viewport_device_width(cairo_t *cr, const RsvgRectangle *viewport) {
+    double dx = viewport->width, dy = 0.0;
+    cairo_user_to_device_distance(cr, &dx, &dy);
+    return (int)ceil(hypot(dx, dy));
+}
+
+typedef struct {
+    LayerElement layer;
+    guint serial;  // LayerRaster serial when started
+    const ThemeRaster *asset;
+    gchar *path;
+    cairo_surface_t *surface;
+} RasterDecode;
+
+static void raster_decode_free(gpointer data) {
+    RasterDecode *decode = data;
+    g_clear_pointer(&decode->surface, cairo_surface_destroy);
+    g_free(decode->path);
+    g_free(decode);
+}
+
+static void raster_decode_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    RasterDecode *decode = task_data;
+    GError *err = NULL;
+    decode->surface = load_raster(decode->path, &err);
+    if (!decode->surface) {
+        g_warning("Failed to load %s: %s", decode->path, err->message);
+        g_error_free(err);
+    }
+    g_task_return_boolean(task, TRUE);
+}
+
+static void on_raster_decoded(GObject *source_object, GAsyncResult *result, gpointer user_data);
+
+static void start_raster_decode(LayerElement e, const ThemeRaster *asset) {
+    RasterDecode *decode = g_new0(RasterDecode, 1);
+    decode->layer = e;
+    decode->serial = layer_rasters[e].serial;
+    decode->asset = asset;
+    decode->path = g_strdup(asset->path);
+    layer_rasters[e].decoding = asset;
+
+    GTask *task = g_task_new(NULL, NULL, on_raster_decoded, NULL);
+    g_task_set_task_data(task, decode, raster_decode_free);
+    g_task_run_in_thread(task, raster_decode_thread);
+    g_object_unref(task);
+}
+
+// Draw the raster asset of layer e best matching the device size; FALSE if it
+// has none. Views only render passes whose assets pass_rasters_ready() found
+// decoded; others, like the one-off renders of --output, decode in place
+static gboolean render_raster_layer(cairo_t *cr, LayerElement e, const RsvgRectangle *viewport,
+                                    RenderQuality quality) {
+    LayerRaster *raster = &layer_rasters[e];
+    if (!raster->assets)
+        return FALSE;
+
+    const ThemeRaster *asset = theme_pick_raster(raster->assets, viewport_device_width(cr, viewport));
+    if (asset != raster->loaded) {
+        GError *err = NULL;
+        g_clear_pointer(&raster->surface, cairo_surface_destroy);
+        raster->surface = load_raster(asset->path, &err);
+        raster->loaded = asset;
+        if (!raster->surface) {
+            // Warn once; the layer stays blank until another asset is picked
+            g_warning("Failed to load %s: %s", asset->path, err->message);
+            g_error_free(err);
+        }
+    }
+    if (raster->surface)
+        paint_raster(cr, raster->surface, viewport, quality);
+    return TRUE;
+}
+
+// Free the decoded assets of the layers of pass once it is rendered; an asset
+// that failed to decode stays loaded, so it is not retried at every render
+static void release_pass_rasters(const RenderPass *pass) {
+    for (size_t i = 0; i < pass->n_layers; i++) {
+        LayerRaster *raster = &layer_rasters[pass->layers[i].source];
+        if (raster->surface) {
+            g_clear_pointer(&raster->surface, cairo_surface_destroy);
+            raster->loaded = NULL;
+        }
+    }
+}
+
+// Draw a static layer's own content, its raster asset or its SVG
+static void render_static_source(cairo_t *cr, LayerElement e, const RsvgRectangle *viewport,
+                                 RenderQuality quality) {
+    if (!render_raster_layer(cr, e, viewport, quality))
+        rsvg_handle_render_document(g_svg_handles[e], cr, viewport, NULL);
+}
+
+// Render a static layer in theme units; a layer with rotational symmetry is
+// rasterized once, for the bounding box of one wedge around 12 o'clock, and
+// that raster is filled into each of the n wedges. The wedges are filled with
+// hard edges through shared vertices, so every pixel comes from exactly one
+// wedge and no seams show where antialiased edges would only partly cover
+static void render_static_layer(cairo_t *cr, LayerElement e, const LayerHints *hints, const RsvgRectangle *viewport,
+                                RenderQuality quality) {
+    if (!g_svg_handles[e] && !layer_rasters[e].assets)
+        return;
+
+    int n = hints->symmetry;
+    if (n <= 1) {
+        render_static_source(cr, e, viewport, quality);
+        return;
+    }
+
+    double cx = theme_width / 2.0, cy = theme_height / 2.0;
+    double half = M_PI / n, radius = hypot(cx, cy);
+    cairo_matrix_t ctm;
+    cairo_get_matrix(cr, &ctm);
+    double sx = fabs(ctm.xx), sy = fabs(ctm.yy);
+
+    // The wedge at 12 o'clock, padded by a device pixel for the filter
+    double box_x = cx - radius * sin(half) - 1.0 / sx, box_y = cy - radius - 1.0 / sy;
+    int wedge_w = (int)ceil((2 * radius * sin(half) + 2.0 / sx) * sx);
+    int wedge_h = (int)ceil((radius + 2.0 / sy) * sy);
+    cairo_surface_t *wedge = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wedge_w, wedge_h);
+    cairo_t *wedge_cr = cairo_create(wedge);
+    cairo_set_antialias(wedge_cr, cairo_get_antialias(cr));
+    cairo_scale(wedge_cr, sx, sy);
+    cairo_translate(wedge_cr, -box_x, -box_y);
+    render_static_source(wedge_cr, e, viewport, quality);
+    cairo_destroy(wedge_cr);
+
+    cairo_pattern_t *pattern = cairo_pattern_create_for_surface(wedge);
+    cairo_pattern_set_extend(pattern, CAIRO_EXTEND_PAD);
+    // Past the canvas corners: the outer edge of each wedge is a polyline
+    // through its middle, far enough out that it never cuts into the canvas
+    double reach = radius / cos(half / 2.0);
+    cairo_save(cr);
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+    for (int i = 0; i < n; i++) {
+        // Boundaries are computed from their index alone, so neighbours share them exactly
+        double a0 = -M_PI / 2.0 + (2 * i - 1) * half, a1 = -M_PI / 2.0 + 2 * i * half;
+        double a2 = -M_PI / 2.0 + (2 * i + 1) * half;
+        cairo_new_path(cr);
+        cairo_move_to(cr, cx, cy);
+        cairo_line_to(cr, cx + reach * cos(a0), cy + reach * sin(a0));
+        cairo_line_to(cr, cx + reach * cos(a1), cy + reach * sin(a1));
+        cairo_line_to(cr, cx + reach * cos(a2), cy + reach * sin(a2));
+        cairo_close_path(cr);
+
+        // Theme units of this wedge to wedge raster pixels: rotate back to 12 o'clock
+        cairo_matrix_t matrix;
+        cairo_matrix_init_scale(&matrix, sx, sy);
+        cairo_matrix_translate(&matrix, cx - box_x, cy - box_y);
+        cairo_matrix_rotate(&matrix, -2 * M_PI * i / n);
+        cairo_matrix_translate(&matrix, -cx, -cy);
+        cairo_pattern_set_matrix(pattern, &matrix);
+        cairo_set_source(cr, pattern);
+        cairo_fill(cr);
+    }
+    cairo_restore(cr);
+    cairo_pattern_destroy(pattern);
+    cairo_surface_destroy(wedge);
+}
+
+// Raster size for a cached pass: the device size, or larger if a layer asks
+// for a minimum raster size (GSK scales the texture down)
+static void pass_raster_size(const RenderPass *pass, int device_w, int device_h, int *raster_w, int *raster_h) {
+    int min_size = 0;
+    for (size_t i = 0; i < pass->n_layers; i++) {
+        min_size = MAX(min_size, layer_hints[pass->layers[i].source].min_size);
+    }
+    double factor = MAX((double)min_size / device_w, 1.0);
+    *raster_w = (int)ceil(device_w * factor);
+    *raster_h = (int)ceil(device_h * factor);
+}
+
+// Fast renders are made at 1/FAST_RASTER_DIVISOR of the device size and scaled
+// up by GSK; best renders draw thin marks at SUPERSAMPLE times the resolution
+// up to a raster width of SUPERSAMPLE_MAX_WIDTH, above which they don't alias
+#define FAST_RASTER_DIVISOR   2
+#define SUPERSAMPLE           2
+#define SUPERSAMPLE_MAX_WIDTH 1024
+
+// Draw a static layer of a raster_w x raster_h pass via a supersampled surface
+static void render_layer_supersampled(cairo_t *cr, const RenderLayer *layer, int raster_w, int raster_h,
+                                      const RsvgRectangle *viewport) {
+    cairo_surface_t *big =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, raster_w * SUPERSAMPLE, raster_h * SUPERSAMPLE);
+    cairo_t *big_cr = cairo_create(big);
+    cairo_set_antialias(big_cr, cairo_get_antialias(cr));
+    cairo_set_tolerance(big_cr, cairo_get_tolerance(cr));
+    cairo_scale(big_cr, (double)raster_w * SUPERSAMPLE / theme_width, (double)raster_h * SUPERSAMPLE / theme_height);
+    cairo_translate(big_cr, layer->offset_x, layer->offset_y);
+    render_static_layer(big_cr, layer->source, &layer_hints[layer->source], viewport, QUALITY_BEST);
+    cairo_destroy(big_cr);
+
+    cairo_save(cr);
+    cairo_identity_matrix(cr);
+    cairo_scale(cr, 1.0 / SUPERSAMPLE, 1.0 / SUPERSAMPLE);
+    cairo_set_source_surface(cr, big, 0.0, 0.0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    cairo_paint(cr);
+    cairo_restore(cr);
+    cairo_surface_destroy(big);
+}
+
+// Size a cached pass is rendered at for quality
+static void pass_render_size(const RenderPass *pass, int device_w, int device_h, RenderQuality quality,
+                             int *raster_w, int *raster_h) {
+    pass_raster_size(pass, device_w, device_h, raster_w, raster_h);
+    if (quality == QUALITY_FAST) {
+        *raster_w = MAX(*raster_w / FAST_RASTER_DIVISOR, 1);
+        *raster_h = MAX(*raster_h / FAST_RASTER_DIVISOR, 1);
+    }
+}
+
+static gboolean layer_supersampled(const RenderLayer *layer, int raster_w, RenderQuality quality) {
+    return quality == QUALITY_BEST && layer->source == CLOCK_MARKS && raster_w <= SUPERSAMPLE_MAX_WIDTH;
+}
+
+// Render the static layers of a cached pass at device-pixel resolution, or
+// below it for fast renders
+static cairo_surface_t *render_pass_surface(const RenderPass *pass, int device_w, int device_h,
+                                            RenderQuality quality) {
+    gint64 start = g_get_monotonic_time();
+    int raster_w, raster_h;
+    pass_render_size(pass, device_w, device_h, quality, &raster_w, &raster_h);
+
+    // Create a Cairo surface to render the layers
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, raster_w, raster_h);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+    cairo_t *cr = cairo_create(surface);
+
+    // Clear to transparent
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+    // Cairo's default tolerance is 0.1 device pixels
+    cairo_set_antialias(cr, quality == QUALITY_BEST ? CAIRO_ANTIALIAS_BEST : CAIRO_ANTIALIAS_FAST);
+    cairo_set_tolerance(cr, quality == QUALITY_BEST ? 0.05 : 0.5);
+
+    // Scale and render the static layers
+    cairo_scale(cr, (double)raster_w / theme_width, (double)raster_h / theme_height);
+
+    RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+
+    for (size_t i = 0; i < pass->n_layers; i++) {
+        const RenderLayer *layer = &pass->layers[i];
+        if (layer_supersampled(layer, raster_w, quality)) {
+            render_layer_supersampled(cr, layer, raster_w, raster_h, &viewport);
+            continue;
+        }
+        cairo_save(cr);
+        cairo_translate(cr, layer->offset_x, layer->offset_y);
+        render_static_layer(cr, layer->source, &layer_hints[layer->source], &viewport, quality);
+        cairo_restore(cr);
+    }
+
+    cairo_destroy(cr);
+
+    metrics.cache_rebuilds++;
+    metrics.last_rebuild_usec = g_get_monotonic_time() - start;
+    metrics.cache_rebuild_usec += metrics.last_rebuild_usec;
+    cache_size_stats(device_w, device_h)->misses++;
+    return surface;
+}
+
+// Whether the raster assets the layers of pass pick at raster_w are decoded;
+// starts decoding those that are not. The widths are worked out like
+// viewport_device_width() does for the contexts render_pass_surface() draws on
+static gboolean pass_rasters_ready(const RenderPass *pass, int raster_w, RenderQuality quality) {
+    gboolean ready = TRUE;
+    for (size_t i = 0; i < pass->n_layers; i++) {
+        const RenderLayer *layer = &pass->layers[i];
+        LayerRaster *raster = &layer_rasters[layer->source];
+        if (!raster->assets)
+            continue;
+        int width = layer_supersampled(layer, raster_w, quality) ? raster_w * SUPERSAMPLE : raster_w;
+        double scale = (double)width / theme_width;
+        const ThemeRaster *asset = theme_pick_raster(raster->assets, (int)ceil(fabs(theme_width * scale)));
+        if (asset == raster->loaded)
+            continue;
+        if (asset != raster->decoding)
+            start_raster_decode(layer->source, asset);
+        ready = FALSE;
+    }
+    return ready;
+}
+
+// Render the texture of a cached pass; FALSE if raster assets it draws are
+// still being decoded, in which case it keeps its previous texture, if any,
+// and nothing is rendered until they are
+static gboolean render_pass_texture(RenderPass *pass, int device_w, int device_h, RenderQuality quality) {
+    int raster_w, raster_h;
+    pass_render_size(pass, device_w, device_h, quality, &raster_w, &raster_h);
+    if (!pass_rasters_ready(pass, raster_w, quality))
+        return FALSE;
+
+    cairo_surface_t *surface = render_pass_surface(pass, device_w, device_h, quality);
+    release_pass_rasters(pass);
+    g_clear_object(&pass->texture);
+    pass->texture = surface ? texture_from_surface(surface) : NULL;
+    pass->quality = quality;
+    return TRUE;
+}
+
+static gboolean render_layers_equal(const RenderPass *a, const RenderPass *b) {
+    if (a->kind != b->kind || a->n_layers != b->n_layers)
+        return FALSE;
+    for (size_t i = 0; i < a->n_layers; i++) {
+        const RenderLayer *la = &a->layers[i], *lb = &b->layers[i];
+        if (la->source != lb->source || la->transform != lb->transform || la->offset_x != lb->offset_x ||
+            la->offset_y != lb->offset_y)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// Give pass i of view a texture at its cache size: another view's of the same
+// device size, layers and quality if there is one, so monitors alike in size
+// and scale rasterize each cached pass once, else a new render
+static void view_pass_texture(ClockView *view, size_t i, RenderQuality quality) {
+    RenderPass *pass = &view->passes[i];
+    int device_w = view->cache_w * view->cache_scale, device_h = view->cache_h * view->cache_scale;
+
+    for (guint v = 0; v < clock_views->len; v++) {
+        const ClockView *other = g_ptr_array_index(clock_views, v);
+        // Views not yet rebuilt by the current build_render_passes() may hold stale textures
+        if (other == view || other->generation != view->generation || i >= other->n_passes)
+            continue;
+        const RenderPass *shared = &other->passes[i];
+        if (shared->texture && !shared->rasters_waiting && shared->quality == quality &&
+            other->cache_w * other->cache_scale == device_w &&
+            other->cache_h * other->cache_scale == device_h && render_layers_equal(pass, shared)) {
+            g_set_object(&pass->texture, shared->texture);
+            pass->quality = quality;
+            pass->rasters_waiting = FALSE;
+            cache_size_stats(device_w, device_h)->hits++;
+            return;
+        }
+    }
+    pass->rasters_waiting = !render_pass_texture(pass, device_w, device_h, quality);
+}
+
+// The size stopped changing: redo the textures rendered while it did, and
+// the hands so motion blur sprites are baked for the new size
+static gboolean on_cache_settled(gpointer user_data) {
+    ClockView *view = user_data;
+    view->cache_settle_id = 0;
+    for (size_t i = 0; i < view->n_passes; i++) {
+        RenderPass *pass = &view->passes[i];
+        if (pass->kind == PASS_CACHED && pass->texture && pass->quality != baked_quality)
+            view_pass_texture(view, i, baked_quality);
+    }
+    view->hands_dirty = TRUE;
+    gtk_widget_queue_draw(view->widget);
+    return G_SOURCE_REMOVE;
+}
+
+// A raster asset was decoded: render the passes that were waiting for it
+static void on_raster_decoded(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    RasterDecode *decode = g_task_get_task_data(G_TASK(result));
+    LayerRaster *raster = &layer_rasters[decode->layer];
+
+    // Dropped if a theme load replaced the assets or another asset was picked since
+    if (decode->serial != raster->serial || decode->asset != raster->decoding)
+        return;
+    raster->decoding = NULL;
+    g_clear_pointer(&raster->surface, cairo_surface_destroy);
+    raster->surface = g_steal_pointer(&decode->surface);
+    raster->loaded = decode->asset;
+
+    for (guint v = 0; v < clock_views->len; v++) {
+        ClockView *view = g_ptr_array_index(clock_views, v);
+        for (size_t i = 0; view->cache_w && i < view->n_passes; i++) {
+            RenderPass *pass = &view->passes[i];
+            if (pass->kind != PASS_CACHED || !pass->rasters_waiting)
+                continue;
+            view_pass_texture(view, i, view->cache_settle_id ? resize_quality : baked_quality);
+            if (view->widget)
+                gtk_widget_queue_draw(view->widget);
+        }
+    }
+}
+
+// Create the cached pass textures (called once per size or scale-factor change)
+static void ensure_layer_caches(ClockView *view, int width, int height) {
+    int scale = gtk_widget_get_scale_factor(view->widget);
+    int old_w = view->cache_w * view->cache_scale, old_h = view->cache_h * view->cache_scale;
+    gboolean resized = width != view->cache_w || height != view->cache_h || scale != view->cache_scale;
+    // The first size is kept; later ones may be steps of an interactive resize
+    gboolean resizing = resized && view->cache_w;
+    RenderQuality quality = resizing ? resize_quality : baked_quality;
+
+    view->cache_w = width;
+    view->cache_h = height;
+    view->cache_scale = scale;
+
+    // Render at device pixels so the textures stay sharp on HiDPI displays
+    for (size_t i = 0; i < view->n_passes; i++) {
+        RenderPass *pass = &view->passes[i];
+        if (pass->kind != PASS_CACHED)
+            continue;
+        if (resized || !pass->texture) {
+            if (pass->texture)
+                cache_size_stats(old_w, old_h)->evictions++;
+            view_pass_texture(view, i, quality);
+        } else {
+            cache_size_stats(width * scale, height * scale)->hits++;
+        }
+    }
+
+    if (resizing) {
+        if (view->cache_settle_id)
+            g_source_remove(view->cache_settle_id);
+        view->cache_settle_id = g_timeout_add(CACHE_SETTLE_MS, on_cache_settled, view);
+    }
+}
+
+// Node showing a cached pass texture over bounds; textures not at the device
+// size (fast renders, min-size hints) are scaled with a filter to match
+static GskRenderNode *cached_pass_node(const RenderPass *pass, const graphene_rect_t *bounds, int device_w) {
+#if GTK_CHECK_VERSION(4, 10, 0)
+    if (gdk_texture_get_width(pass->texture) != device_w)
+        return gsk_texture_scale_node_new(pass->texture, bounds,
+                                          pass->quality == QUALITY_BEST ? GSK_SCALING_FILTER_TRILINEAR
+                                                                        : GSK_SCALING_FILTER_LINEAR);
+#endif
+    return gsk_texture_node_new(pass->texture, bounds);
+}
+
+static GdkTexture *cached_node_texture(GskRenderNode *node) {
+#if GTK_CHECK_VERSION(4, 10, 0)
+    if (gsk_render_node_get_node_type(node) == GSK_TEXTURE_SCALE_NODE)
+        return gsk_texture_scale_node_get_texture(node);
+#endif
+    return gsk_texture_node_get_texture(node);
+}
+
+// Draw a hand sprite at angle, rotated about its pivot; cr is in theme units
+// with the origin at the clock centre and 12 o'clock along +x. With a shadow
+// colour the sprite's alpha masks that colour
+static void draw_hand_sprite(cairo_t *cr, RsvgHandle *handle, const LayerHints *source_hints,
+                             const GdkRGBA *shadow_color, double angle, const RsvgRectangle *viewport) {
+    cairo_save(cr);
+    cairo_rotate(cr, angle);
+    cairo_translate(cr, -source_hints->pivot_x, -source_hints->pivot_y);
+
+    if (shadow_color) {
+        cairo_push_group(cr);
+        rsvg_handle_render_document(handle, cr, viewport, NULL);
+        cairo_pattern_t *sprite = cairo_pop_group(cr);
+        gdk_cairo_set_source_rgba(cr, shadow_color);
+        cairo_mask(cr, sprite);
+        cairo_pattern_destroy(sprite);
+    } else {
+        rsvg_handle_render_document(handle, cr, viewport, NULL);
+    }
+    cairo_restore(cr);
+}
+
+// Render a hand or hand shadow of the current theme; a shadow derived from
+// its hand by the manifest is the hand's alpha, tinted
+static void render_hand_layer(cairo_t *cr, LayerElement e, const LayerHints *hints, double angle,
+                              const RsvgRectangle *viewport) {
+    LayerElement source = hints->shadow_of >= 0 ? (LayerElement)hints->shadow_of : e;
+    RsvgHandle *handle = g_svg_handles[source];
+    if (!handle)
+        return;
+
+    const LayerHints *source_hints = source == e ? hints : &layer_hints[source];
+    draw_hand_sprite(cr, handle, source_hints, source != e ? &hints->shadow_color : NULL, angle, viewport);
+}
+
+// --check-hints: render each hinted layer with and without its hints and
+// report whether the shortcut matches what the SVG actually draws
+#define HINT_CHECK_SIZE      256
+#define HINT_CHECK_TOLERANCE 0.01  // mean absolute difference per channel, 0..1
+
+static cairo_surface_t *render_hint_check(LayerElement e, const LayerHints *hints) {
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, HINT_CHECK_SIZE, HINT_CHECK_SIZE);
+    cairo_t *cr = cairo_create(surface);
+    RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+
+    cairo_scale(cr, (double)HINT_CHECK_SIZE / theme_width, (double)HINT_CHECK_SIZE / theme_height);
+    if (layer_transform(e) != TRANSFORM_STATIC) {
+        cairo_translate(cr, theme_width / 2.0, theme_height / 2.0);
+        cairo_rotate(cr, -M_PI / 2.0);
+        render_hand_layer(cr, e, hints, 0.0, &viewport);
+    } else {
+        render_static_layer(cr, e, hints, &viewport, QUALITY_BEST);
+    }
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+    return surface;
+}
+
+static double surface_difference(cairo_surface_t *a, cairo_surface_t *b) {
+    const guchar *pa = cairo_image_surface_get_data(a), *pb = cairo_image_surface_get_data(b);
+    int stride = cairo_image_surface_get_stride(a);
+    double sum = 0.0;
+    for (int y = 0; y < HINT_CHECK_SIZE; y++) {
+        for (int x = 0; x < HINT_CHECK_SIZE * 4; x++) {
+            sum += abs(pa[y * stride + x] - pb[y * stride + x]);
+        }
+    }
+    return sum / (255.0 * HINT_CHECK_SIZE * HINT_CHECK_SIZE * 4);
+}
+
+// Alpha bounding box of a surface rendered by render_hint_check(), in theme units
+// relative to the clock centre with 12 o'clock along +x
+static gboolean hand_alpha_bounds(cairo_surface_t *s, double *x0, double *y0, double *x1, double *y1) {
+    const guchar *p = cairo_image_surface_get_data(s);
+    int stride = cairo_image_surface_get_stride(s);
+    int min_x = HINT_CHECK_SIZE, min_y = HINT_CHECK_SIZE, max_x = -1, max_y = -1;
+    for (int y = 0; y < HINT_CHECK_SIZE; y++) {
+        for (int x = 0; x < HINT_CHECK_SIZE; x++) {
+            if (((const guint32 *)(p + y * stride))[x] >> 24) {
+                min_x = MIN(min_x, x);
+                max_x = MAX(max_x, x);
+                min_y = MIN(min_y, y);
+                max_y = MAX(max_y, y);
+            }
+        }
+    }
+    if (max_x < 0)
+        return FALSE;
+    // Undo the -90 degree rotation: screen up is +x in hand coordinates
+    double ux = (double)theme_width / HINT_CHECK_SIZE, uy = (double)theme_height / HINT_CHECK_SIZE;
+    double cx = HINT_CHECK_SIZE / 2.0, cy = HINT_CHECK_SIZE / 2.0;
+    *x0 = (cy - max_y - 1) * uy;
+    *x1 = (cy - min_y) * uy;
+    *y0 = (min_x - cx) * ux;
+    *y1 = (max_x + 1 - cx) * ux;
+    return TRUE;
+}
+
+static void validate_layer_hints(void) {
+    LayerHints plain[CLOCK_ELEMENTS];
+    layer_hints_init(plain);
+
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        const LayerHints *h = &layer_hints[e];
+        const char *file = layer_files[e].file;
+
+        gboolean moving = layer_transform(e) != TRANSFORM_STATIC;
+        if (h->dynamic >= 0 && h->dynamic != moving)
+            g_print("%s: declared %s but clok4 draws it as a %s layer\n", file, h->dynamic ? "dynamic" : "static",
+                    moving ? "dynamic" : "static");
+
+        if (h->symmetry > 1 && g_svg_handles[e]) {
+            cairo_surface_t *full = render_hint_check(e, &plain[e]);
+            cairo_surface_t *replicated = render_hint_check(e, h);
+            double diff = surface_difference(full, replicated);
+            g_print("%s: symmetry %d %s (difference %.4f)\n", file, h->symmetry,
+                    diff <= HINT_CHECK_TOLERANCE ? "ok" : "MISMATCH", diff);
+            cairo_surface_destroy(full);
+            cairo_surface_destroy(replicated);
+        }
+
+        if (h->shadow_of >= 0) {
+            RsvgHandle *own = load_svg(file, FALSE);
+            if (own) {
+                g_svg_handles[e] = own;
+                cairo_surface_t *drawn = render_hint_check(e, &plain[e]);
+                g_svg_handles[e] = NULL;
+                cairo_surface_t *derived = render_hint_check(e, h);
+                double diff = surface_difference(drawn, derived);
+                g_print("%s: shadow-of %s %s (difference %.4f)\n", file, layer_files[h->shadow_of].file,
+                        diff <= HINT_CHECK_TOLERANCE ? "ok" : "MISMATCH", diff);
+                cairo_surface_destroy(drawn);
+                cairo_surface_destroy(derived);
+                g_object_unref(own);
+            } else {
+                g_print("%s: shadow-of %s, no SVG to compare against\n", file, layer_files[h->shadow_of].file);
+            }
+        }
+
+        if (moving && !layer_is_shadow(e) && g_svg_handles[e]) {
+            double x0, y0, x1, y1;
+            cairo_surface_t *s = render_hint_check(e, h);
+            // With the pivot applied the hand must still surround the clock centre
+            if (hand_alpha_bounds(s, &x0, &y0, &x1, &y1) && (x0 > 0.5 || x1 < -0.5 || y0 > 0.5 || y1 < -0.5))
+                g_print("%s: pivot %g,%g lies outside the hand (%.1f,%.1f)-(%.1f,%.1f)\n", file, h->pivot_x,
+                        h->pivot_y, x0, y0, x1, y1);
+            cairo_surface_destroy(s);
+        }
+    }
+}
+
+static double transform_angle(const HandAngles *angles, LayerTransform transform) {
+    switch (transform) {
+    case TRANSFORM_HOUR:
+        return angles->hour;
+    case TRANSFORM_MINUTE:
+        return angles->minute;
+    case TRANSFORM_SECOND:
+        return angles->second;
+    default:
+        return 0.0;
+    }
+}
+
+// A retained hand node is redrawn once the hand's tip has moved this far
+#define HAND_REUSE_PIXELS 0.25
+
+// Widget-space bounds of a hand layer at angle, from its sprite's ink extents
+static graphene_rect_t hand_layer_bounds(const RenderLayer *layer, double angle, int width, int height) {
+    graphene_rect_t full = GRAPHENE_RECT_INIT(0, 0, width, height);
+    if (!layer->has_ink)
+        return full;
+
+    int shadow_of = layer_hints[layer->source].shadow_of;
+    const LayerHints *source_hints = &layer_hints[shadow_of >= 0 ? shadow_of : (int)layer->source];
+    double sx = (double)width / theme_width;
+    double sy = (double)height / theme_height;
+    double c = cos(angle - M_PI / 2.0), s = sin(angle - M_PI / 2.0);
+    double x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+
+    for (int k = 0; k < 4; k++) {
+        double qx = layer->ink.x + (k & 1 ? layer->ink.width : 0.0) - source_hints->pivot_x;
+        double qy = layer->ink.y + (k & 2 ? layer->ink.height : 0.0) - source_hints->pivot_y;
+        double x = width / 2.0 + sx * (qx * c - qy * s + layer->offset_x);
+        double y = height / 2.0 + sy * (qx * s + qy * c + layer->offset_y);
+        x0 = MIN(x0, x);
+        y0 = MIN(y0, y);
+        x1 = MAX(x1, x);
+        y1 = MAX(y1, y);
+    }
+
+    // A pixel of slack for antialiasing
+    graphene_rect_t ink = GRAPHENE_RECT_INIT(floor(x0) - 1, floor(y0) - 1, ceil(x1) - floor(x0) + 2,
+                                             ceil(y1) - floor(y0) + 2);
+    graphene_rect_t bounds;
+    if (!graphene_rect_intersection(&ink, &full, &bounds))
+        return GRAPHENE_RECT_INIT(0, 0, 0, 0);
+    return bounds;
+}
+
+// Draw one hand layer at angle; cr is in widget coordinates
+static void draw_hand_layer(cairo_t *cr, const RenderLayer *layer, double angle, int width, int height) {
+    RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+    cairo_translate(cr, width / 2.0, height / 2.0);
+    cairo_scale(cr, (double)width / theme_width, (double)height / theme_height);
+    cairo_translate(cr, layer->offset_x, layer->offset_y);
+    cairo_rotate(cr, -M_PI / 2.0);
+    render_hand_layer(cr, layer->source, &layer_hints[layer->source], angle, &viewport);
+}
+
+// Draw one hand layer into a cairo node covering just the hand, so GSK's
+// damage for a moved hand is its old and new footprint
+static GskRenderNode *render_hand_layer_node(const RenderLayer *layer, double angle, int width, int height) {
+    graphene_rect_t bounds = hand_layer_bounds(layer, angle, width, height);
+    if (bounds.size.width <= 0 || bounds.size.height <= 0)
+        return NULL;
+
+    GskRenderNode *node = gsk_cairo_node_new(&bounds);
+    cairo_t *cr = gsk_cairo_node_get_draw_context(node);
+    draw_hand_layer(cr, layer, angle, width, height);
+    cairo_destroy(cr);
+    return node;
+}
+
+// Like render_hand_layer_node(), but rasterized into a texture now instead of
+// by GSK when the frame is rendered
+static GskRenderNode *render_hand_layer_texture_node(const RenderLayer *layer, double angle, int width, int height,
+                                                     int scale) {
+    graphene_rect_t bounds = hand_layer_bounds(layer, angle, width, height);
+    if (bounds.size.width <= 0 || bounds.size.height <= 0)
+        return NULL;
+
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, (int)bounds.size.width * scale,
+                                                          (int)bounds.size.height * scale);
+    cairo_t *cr = cairo_create(surface);
+    cairo_scale(cr, scale, scale);
+    cairo_translate(cr, -bounds.origin.x, -bounds.origin.y);
+    draw_hand_layer(cr, layer, angle, width, height);
+    cairo_destroy(cr);
+
+    GdkTexture *texture = texture_from_surface(surface);
+    GskRenderNode *node = gsk_texture_node_new(texture, &bounds);
+    g_object_unref(texture);
+    return node;
+}
+
+// Shadow of a hand as a tinted, offset and optionally blurred copy of the
+// hand's node; GSK does this when compositing, so the shadow itself is never
+// rasterized
+static GskRenderNode *derive_shadow_node(const RenderLayer *layer, GskRenderNode *hand, int width, int height) {
+    if (!hand)
+        return NULL;
+
+    const LayerHints *h = &layer_hints[layer->source];
+    double sx = (double)width / theme_width;
+    double sy = (double)height / theme_height;
+
+    // Keep the hand's alpha scaled by the shadow's; the colour comes from the offset
+    const float a[4][4] = {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, h->shadow_color.alpha}};
+    graphene_matrix_t matrix;
+    graphene_vec4_t offset;
+    color_matrix_init(&matrix, a);
+    graphene_vec4_init(&offset, h->shadow_color.red, h->shadow_color.green, h->shadow_color.blue, 0);
+    GskRenderNode *node = gsk_color_matrix_node_new(hand, &matrix, &offset);
+
+    if (h->shadow_blur > 0.0) {
+        GskRenderNode *blurred = gsk_blur_node_new(node, h->shadow_blur * sx);
+        gsk_render_node_unref(node);
+        node = blurred;
+    }
+
+    graphene_point_t delta = GRAPHENE_POINT_INIT(layer->offset_x * sx, layer->offset_y * sy);
+    GskTransform *shift = gsk_transform_translate(NULL, &delta);
+    GskRenderNode *shifted = gsk_transform_node_new(node, shift);
+    gsk_transform_unref(shift);
+    gsk_render_node_unref(node);
+    return shifted;
+}
+
+// --motion-blur: while the hands sweep, a second-hand layer is drawn as a
+// sprite averaging it over the arc swept in one redraw interval, so low
+// refresh rates still look smooth. The sprite is baked once per device size
+// and interval, pointing at 12 o'clock, and GSK rotates it into place. While
+// the view is being resized the hand is drawn sharp instead of rebaking the
+// sprite at every step; it is baked once the size settles
+#define MOTION_BLUR_MIN_PIXELS  1.0  // shorter sweeps at the tip are drawn sharp
+#define MOTION_BLUR_MAX_SAMPLES 16
+
+// Angle the second hand sweeps in one redraw interval of interval usec
+static double motion_blur_sweep(gint64 interval) {
+    double period = railway_mode ? RAILWAY_SWEEP_SECONDS : 60.0;
+    return 2 * M_PI * interval / (period * G_USEC_PER_SEC);
+}
+
+static gboolean motion_blur_wanted(const RenderLayer *layer, ClockMotion motion, double radius, gint64 interval) {
+    return motion_blur && layer->transform == TRANSFORM_SECOND && motion == MOTION_SWEEP && interval > 0 &&
+           motion_blur_sweep(interval) * radius >= MOTION_BLUR_MIN_PIXELS;
+}
+
+// Bake the blurred sprite of a layer for the current size and interval;
+// returns TRUE if it was (re)baked, so nodes built from the old one are stale
+static gboolean blur_sprite_ensure(BlurSprite *sprite, const RenderLayer *layer, int width, int height, int scale,
+                                   gint64 interval) {
+    if (sprite->texture && sprite->width == width && sprite->height == height && sprite->scale == scale &&
+        sprite->interval == interval)
+        return FALSE;
+
+    gint64 start = g_get_monotonic_time();
+    int device_w = width * scale, device_h = height * scale;
+    double sweep = motion_blur_sweep(interval);
+    double radius = MAX(device_w, device_h) / 2.0;
+    int n = CLAMP((int)ceil(sweep * radius), 2, MOTION_BLUR_MAX_SAMPLES);
+
+    // The offset is applied after rotation, so the sprite is baked without it
+    RenderLayer centred = *layer;
+    centred.offset_x = centred.offset_y = 0.0;
+    graphene_rect_t bounds = GRAPHENE_RECT_INIT(0, 0, 0, 0);
+    for (int k = 0; k < n; k++) {
+        graphene_rect_t r = hand_layer_bounds(&centred, -sweep * k / (n - 1), device_w, device_h);
+        if (k == 0)
+            bounds = r;
+        else
+            graphene_rect_union(&bounds, &r, &bounds);
+    }
+
+    g_clear_object(&sprite->texture);
+    sprite->width = width;
+    sprite->height = height;
+    sprite->scale = scale;
+    sprite->interval = interval;
+    if (bounds.size.width <= 0 || bounds.size.height <= 0)
+        return TRUE;
+
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, (int)ceil(bounds.size.width),
+                                                          (int)ceil(bounds.size.height));
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return TRUE;
+    }
+    cairo_t *cr = cairo_create(surface);
+    RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+
+    cairo_translate(cr, device_w / 2.0 - bounds.origin.x, device_h / 2.0 - bounds.origin.y);
+    cairo_scale(cr, (double)device_w / theme_width, (double)device_h / theme_height);
+    cairo_rotate(cr, -M_PI / 2.0);
+
+    // Average of n positions trailing the hand: each is added at 1/n alpha
+    for (int k = 0; k < n; k++) {
+        cairo_push_group(cr);
+        render_hand_layer(cr, layer->source, &layer_hints[layer->source], -sweep * k / (n - 1), &viewport);
+        cairo_pop_group_to_source(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_ADD);
+        cairo_paint_with_alpha(cr, 1.0 / n);
+        cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+    }
+    cairo_destroy(cr);
+
+    sprite->texture = texture_from_surface(surface);
+    graphene_rect_init(&sprite->bounds, bounds.origin.x / scale, bounds.origin.y / scale,
+                       ceil(bounds.size.width) / scale, ceil(bounds.size.height) / scale);
+    metrics.cache_rebuilds++;
+    metrics.last_rebuild_usec = g_get_monotonic_time() - start;
+    metrics.cache_rebuild_usec += metrics.last_rebuild_usec;
+    return TRUE;
+}
+
+// The baked sprite rotated to angle about the clock centre, then offset
+static GskRenderNode *blur_sprite_node(const BlurSprite *sprite, const RenderLayer *layer, double angle, int width,
+                                       int height) {
+    GskRenderNode *texture = gsk_texture_node_new(sprite->texture, &sprite->bounds);
+    graphene_point_t pivot = GRAPHENE_POINT_INIT(width / 2.0 + layer->offset_x * width / theme_width,
+                                                 height / 2.0 + layer->offset_y * height / theme_height);
+    graphene_point_t centre = GRAPHENE_POINT_INIT(-width / 2.0, -height / 2.0);
+    GskTransform *transform = gsk_transform_translate(NULL, &pivot);
+    transform = gsk_transform_rotate(transform, angle * 180.0 / M_PI);
+    transform = gsk_transform_translate(transform, &centre);
+    GskRenderNode *node = gsk_transform_node_new(texture, transform);
+    gsk_transform_unref(transform);
+    gsk_render_node_unref(texture);
+    return node;
+}
+
+// Bring the per-layer nodes of a dynamic pass up to date. A layer whose tip
+// moved less than HAND_REUSE_PIXELS keeps its node object, and the container
+// is only rebuilt when a child changed, so GSK's node diff reports no damage
+// for hands that did not move. sweep_interval is the view's redraw interval;
+// resizing is set until the view's size has settled
+static void update_dynamic_pass(RenderPass *pass, int width, int height, int scale, gint64 sweep_interval,
+                                gboolean resizing) {
+    gboolean resized = width != pass->node_w || height != pass->node_h;
+    double radius = MAX(width, height) / 2.0 * scale;  // device pixels, generous for any hand
+    gboolean changed = FALSE;
+
+    struct timespec ts;
+    HandAngles angles;
+    gint64 still_usec;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    compute_hand_angles(&ts, &angles);
+    ScheduleSettings settings = schedule_settings();
+    ClockMotion motion = clock_motion(&ts, &settings, &still_usec);
+
+    gboolean rebuilt[CLOCK_ELEMENTS] = {FALSE};
+    for (size_t i = 0; i < pass->n_layers; i++) {
+        const RenderLayer *layer = &pass->layers[i];
+        double angle = transform_angle(&angles, layer->transform);
+        if (layer->derive_from >= 0)
+            continue;
+        BlurSprite *sprite = &pass->blur_sprites[i];
+        gboolean blurred = motion_blur_wanted(layer, motion, radius, sweep_interval);
+        if (resizing && (sprite->width != width || sprite->height != height || sprite->scale != scale))
+            blurred = FALSE;
+        gboolean baked = blurred && blur_sprite_ensure(sprite, layer, width, height, scale, sweep_interval);
+        blurred = blurred && sprite->texture;
+        if (!resized && !baked && pass->layer_nodes[i] && blurred == pass->layer_blurred[i] &&
+            fabs(angle - pass->layer_angles[i]) * radius < HAND_REUSE_PIXELS) {
+            node_stats.reused++;
+            continue;
+        }
+        g_clear_pointer(&pass->layer_nodes[i], gsk_render_node_unref);
+        if (!blurred && pass->prepared_nodes[i] && pass->prepared_w == width && pass->prepared_h == height &&
+            pass->prepared_scale == scale && fabs(angle - pass->prepared_angles[i]) * radius < HAND_REUSE_PIXELS) {
+            // Rendered ahead by prepare_next_hands()
+            pass->layer_nodes[i] = g_steal_pointer(&pass->prepared_nodes[i]);
+            angle = pass->prepared_angles[i];
+            node_stats.prepared++;
+        } else {
+            pass->layer_nodes[i] = blurred ? blur_sprite_node(sprite, layer, angle, width, height)
+                                           : render_hand_layer_node(layer, angle, width, height);
+        }
+        pass->layer_angles[i] = angle;
+        pass->layer_blurred[i] = blurred;
+        node_stats.built++;
+        rebuilt[i] = changed = TRUE;
+    }
+
+    // Derived shadows follow their hand's node
+    for (size_t i = 0; i < pass->n_layers; i++) {
+        const RenderLayer *layer = &pass->layers[i];
+        if (layer->derive_from < 0)
+            continue;
+        if (!resized && pass->layer_nodes[i] && !rebuilt[layer->derive_from]) {
+            node_stats.reused++;
+            continue;
+        }
+        g_clear_pointer(&pass->layer_nodes[i], gsk_render_node_unref);
+        pass->layer_nodes[i] = derive_shadow_node(layer, pass->layer_nodes[layer->derive_from], width, height);
+        node_stats.built++;
+        changed = TRUE;
+    }
+
+    if (changed || !pass->node) {
+        GskRenderNode *children[CLOCK_ELEMENTS];
+        guint n_children = 0;
+        for (size_t i = 0; i < pass->n_layers; i++) {
+            if (pass->layer_nodes[i])
+                children[n_children++] = pass->layer_nodes[i];
+        }
+        g_clear_pointer(&pass->node, gsk_render_node_unref);
+        pass->node = gsk_container_node_new(children, n_children);
+    }
+    pass->node_w = width;
+    pass->node_h = height;
+}
+
+// Frames prepared ahead of time. When the next positions of the hour and
+// minute hands are known exactly in advance their nodes are rasterized at low
+// priority once the current frame is painted, so the redraw at the deadline
+// only swaps them in. Second hands keep sweeping and are always drawn live
+
+// Time of the next hand redraw whose positions are known now: the landing of
+// the next minute jump of a resting railway clock, or the next redraw of a
+// sweeping clock without second hand (every sweep_interval); FALSE otherwise
+static gboolean next_hands_time(const struct timespec *now, gint64 sweep_interval, struct timespec *next) {
+    ScheduleSettings settings = schedule_settings();
+    gint64 still_usec = 0, ahead;
+
+    switch (clock_motion(now, &settings, &still_usec)) {
+    case MOTION_STILL:
+        ahead = still_usec + (gint64)(RAILWAY_JUMP_SECONDS * G_USEC_PER_SEC);
+        break;
+    case MOTION_SWEEP:
+        if (settings.seconds || sweep_interval <= 0)
+            return FALSE;
+        ahead = sweep_interval;
+        break;
+    default:
+        return FALSE;
+    }
+    gint64 nsec = now->tv_nsec + ahead * 1000;
+    next->tv_sec = now->tv_sec + nsec / 1000000000;
+    next->tv_nsec = nsec % 1000000000;
+    return TRUE;
+}
+
+static gboolean prepare_next_hands(gpointer user_data) {
+    ClockView *view = user_data;
+    struct timespec now, next;
+    view->prepare_id = 0;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (!next_hands_time(&now, view->scheduler.sweep_interval, &next))
+        return G_SOURCE_REMOVE;
+
+    HandAngles angles;
+    compute_hand_angles(&next, &angles);
+    int scale = gtk_widget_get_scale_factor(view->widget);
+
+    for (size_t p = 0; p < view->n_passes; p++) {
+        RenderPass *pass = &view->passes[p];
+        if (pass->kind != PASS_DYNAMIC || !pass->node)
+            continue;
+        int width = pass->node_w, height = pass->node_h;
+        double radius = MAX(width, height) / 2.0 * scale;
+        if (pass->prepared_w != width || pass->prepared_h != height || pass->prepared_scale != scale) {
+            for (size_t i = 0; i < pass->n_layers; i++) {
+                g_clear_pointer(&pass->prepared_nodes[i], gsk_render_node_unref);
+            }
+        }
+
+        for (size_t i = 0; i < pass->n_layers; i++) {
+            const RenderLayer *layer = &pass->layers[i];
+            if (layer->derive_from >= 0 || layer->transform == TRANSFORM_SECOND)
+                continue;
+            double angle = transform_angle(&angles, layer->transform);
+            // The shown node will still do, or the prepared one already matches
+            if (pass->layer_nodes[i] && fabs(angle - pass->layer_angles[i]) * radius < HAND_REUSE_PIXELS)
+                continue;
+            if (pass->prepared_nodes[i] && fabs(angle - pass->prepared_angles[i]) * radius < HAND_REUSE_PIXELS)
+                continue;
+            g_clear_pointer(&pass->prepared_nodes[i], gsk_render_node_unref);
+            pass->prepared_nodes[i] = render_hand_layer_texture_node(layer, angle, width, height, scale);
+            pass->prepared_angles[i] = angle;
+        }
+        pass->prepared_w = width;
+        pass->prepared_h = height;
+        pass->prepared_scale = scale;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void on_prepare_after_paint(GdkFrameClock *frame_clock, gpointer user_data) {
+    ClockView *view = user_data;
+    if (!view->prepare_id)
+        view->prepare_id = g_idle_add_full(G_PRIORITY_LOW, prepare_next_hands, view, NULL);
+}
+
+// The frame clock belongs to the view's window, which may close before the
+// application does (--all-monitors)
+static void on_prepare_realize(GtkWidget *widget, gpointer user_data) {
+    g_signal_connect(gtk_widget_get_frame_clock(widget), "after-paint", G_CALLBACK(on_prepare_after_paint), user_data);
+}
+
+static void on_prepare_unrealize(GtkWidget *widget, gpointer user_data) {
+    g_signal_handlers_disconnect_by_func(gtk_widget_get_frame_clock(widget), on_prepare_after_paint, user_data);
+}
+
+// Chronograph subdial: position and radius as fractions of the clock size, and
+// how the stopwatch time maps to the hand angle
+typedef struct {
+    LayerElement hand;
+    double cx, cy, radius;
+    gint64 period;  // usec per revolution
+    gint64 step;    // hand moves in steps of this many usec; 0 for a sweeping hand
+} ChronoSubdial;
+
+static const ChronoSubdial chrono_subdials[N_CHRONO_SUBDIALS] = {
+    {.hand = CLOCK_CHRONO_SECONDS_HAND, .cx = 0.30, .cy = 0.50, .radius = 0.11,
+     .period = 60 * G_TIME_SPAN_SECOND, .step = G_TIME_SPAN_SECOND / 10},
+    {.hand = CLOCK_CHRONO_MINUTES_HAND, .cx = 0.70, .cy = 0.50, .radius = 0.11,
+     .period = 30 * G_TIME_SPAN_MINUTE, .step = G_TIME_SPAN_MINUTE},
+    {.hand = CLOCK_CHRONO_TENTHS_HAND, .cx = 0.50, .cy = 0.70, .radius = 0.11,
+     .period = G_TIME_SPAN_SECOND, .step = 0},
+};
+
+// Subdial ring with 12 ticks; cr has the origin at the subdial centre
+static void draw_subdial_ring(cairo_t *cr, double r) {
+    cairo_set_source_rgba(cr, 0.2, 0.2, 0.2, 0.6);
+    cairo_set_line_width(cr, MAX(r * 0.03, 0.5));
+    cairo_arc(cr, 0, 0, r * 0.95, 0, 2 * M_PI);
+    cairo_stroke(cr);
+    for (int i = 0; i < 12; i++) {
+        double a = i * M_PI / 6.0;
+        cairo_move_to(cr, cos(a) * r * 0.80, sin(a) * r * 0.80);
+        cairo_line_to(cr, cos(a) * r * 0.92, sin(a) * r * 0.92);
+    }
+    cairo_stroke(cr);
+}
+
+// Subdial hand pointing at 12 o'clock; cr has the origin at the subdial centre
+static void draw_subdial_hand(cairo_t *cr, const ChronoSubdial *dial, double r) {
+    cairo_rotate(cr, -M_PI / 2.0);
+
+    if (g_svg_handles[dial->hand]) {
+        // Theme hands are drawn like the main hands, pivot at the origin, so
+        // scale the clock radius down to the subdial radius
+        double scale = r / (theme_width / 2.0);
+        RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+        cairo_scale(cr, scale, scale);
+        rsvg_handle_render_document(g_svg_handles[dial->hand], cr, &viewport, NULL);
+    } else {
+        cairo_set_source_rgb(cr, 0.75, 0.1, 0.1);
+        cairo_set_line_width(cr, MAX(r * 0.05, 1.0));
+        cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+        cairo_move_to(cr, -r * 0.15, 0);
+        cairo_line_to(cr, r * 0.85, 0);
+        cairo_stroke(cr);
+        cairo_arc(cr, 0, 0, MAX(r * 0.06, 1.0), 0, 2 * M_PI);
+        cairo_fill(cr);
+    }
+}
+
+static void subdial_clear(SubdialNode *cache) {
+    g_clear_object(&cache->ring);
+    g_clear_object(&cache->hand);
+    g_clear_pointer(&cache->ring_node, gsk_render_node_unref);
+    g_clear_pointer(&cache->node, gsk_render_node_unref);
+    cache->w = cache->h = cache->scale = 0;
+}
+
+// Rasterize the ring and the hand of a subdial for the view size, each into a
+// texture of the square bounding the subdial
+static void bake_subdial(const ChronoSubdial *dial, SubdialNode *cache, int width, int height, int scale) {
+    double cx = dial->cx * width, cy = dial->cy * height;
+    double r = dial->radius * MIN(width, height);
+    graphene_rect_t bounds = GRAPHENE_RECT_INIT(floor(cx - r), floor(cy - r), ceil(2 * r) + 1, ceil(2 * r) + 1);
+    int device = (int)bounds.size.width * scale;
+
+    subdial_clear(cache);
+    cache->bounds = bounds;
+    cache->w = width;
+    cache->h = height;
+    cache->scale = scale;
+    for (int part = 0; part < 2; part++) {
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, device, device);
+        if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+            cairo_surface_destroy(surface);
+            continue;
+        }
+        cairo_t *cr = cairo_create(surface);
+        cairo_scale(cr, scale, scale);
+        cairo_translate(cr, cx - bounds.origin.x, cy - bounds.origin.y);
+        if (part == 0)
+            draw_subdial_ring(cr, r);
+        else
+            draw_subdial_hand(cr, dial, r);
+        cairo_destroy(cr);
+        if (part == 0)
+            cache->ring = texture_from_surface(surface);
+        else
+            cache->hand = texture_from_surface(surface);
+    }
+    if (cache->ring)
+        cache->ring_node = gsk_texture_node_new(cache->ring, &cache->bounds);
+}
+
+// The baked ring, with the baked hand rotated to value about the subdial centre
+static GskRenderNode *subdial_node(const ChronoSubdial *dial, const SubdialNode *cache, gint64 value, int width,
+                                   int height) {
+    GskRenderNode *children[2];
+    int n = 0;
+    if (cache->ring_node)
+        children[n++] = gsk_render_node_ref(cache->ring_node);
+    if (cache->hand) {
+        double angle = 360.0 * (double)(value % dial->period) / dial->period;
+        graphene_point_t centre = GRAPHENE_POINT_INIT(dial->cx * width, dial->cy * height);
+        graphene_point_t back = GRAPHENE_POINT_INIT(-centre.x, -centre.y);
+        GskRenderNode *hand = gsk_texture_node_new(cache->hand, &cache->bounds);
+        GskTransform *transform = gsk_transform_translate(NULL, &centre);
+        transform = gsk_transform_rotate(transform, angle);
+        transform = gsk_transform_translate(transform, &back);
+        children[n++] = gsk_transform_node_new(hand, transform);
+        gsk_transform_unref(transform);
+        gsk_render_node_unref(hand);
+    }
+    GskRenderNode *node = gsk_container_node_new(children, n);
+    for (int i = 0; i < n; i++) {
+        gsk_render_node_unref(children[i]);
+    }
+    return node;
+}
+
+// The rings and hands are only rasterized when the size changes; a moved hand
+// costs a transform node, even the tenths hand running at CHRONO_HZ
+static void snapshot_chrono_subdials(ClockView *view, GtkSnapshot *snapshot, int width, int height, int scale) {
+    gint64 elapsed = stopwatch_elapsed();
+
+    for (size_t i = 0; i < G_N_ELEMENTS(chrono_subdials); i++) {
+        const ChronoSubdial *dial = &chrono_subdials[i];
+        SubdialNode *cache = &view->subdials[i];
+        gint64 value = dial->step ? elapsed - elapsed % dial->step : elapsed;
+
+        if (width != cache->w || height != cache->h || scale != cache->scale)
+            bake_subdial(dial, cache, width, height, scale);
+        // Reuse the retained node until the hand moves, e.g. the minutes hand
+        // is rebuilt once a minute even while the tenths hand runs at full rate
+        if (!cache->node || value != cache->value) {
+            g_clear_pointer(&cache->node, gsk_render_node_unref);
+            cache->node = subdial_node(dial, cache, value, width, height);
+            cache->value = value;
+        }
+        gtk_snapshot_append_node(snapshot, cache->node);
+    }
+}
+
+// Known new moon (2000-01-06 18:14 UTC) and mean synodic month for the moon phase
+#define MOON_EPOCH_UNIX 947182440
+#define MOON_SYNODIC_DAYS 29.530588853
+
+// A complication draws slowly changing content into a cached texture per view
+// (ComplicationTexture) and reports when that content next changes; it is only
+// redrawn at that moment (or on resize), so snapshots just append the texture
+typedef struct {
+    const char *name;
+    double x, y, w, h;          // area as fractions of the clock size
+    double chrono_x, chrono_y;  // where the area moves clear of the chronograph subdials
+    // Draw for local time now into a w x h logical area; returns the real time
+    // (usec since the epoch) at which the content next changes
+    gint64 (*draw)(cairo_t *cr, double w, double h, GDateTime *now);
+    // Optional: the part of the w x h area drawn into at now, for content much
+    // smaller than its area; the texture only covers that part
+    void (*ink)(double w, double h, GDateTime *now, graphene_rect_t *ink);
+    gboolean enabled;
+} Complication;
+
+static GTimeZone *timezone2_tz = NULL;
+
+static gint64 next_local_midnight(GDateTime *now) {
+    GDateTime *today = g_date_time_new(g_date_time_get_timezone(now), g_date_time_get_year(now),
+                                       g_date_time_get_month(now), g_date_time_get_day_of_month(now), 0, 0, 0);
+    // Adding a day keeps the wall-clock time, so this stays midnight across DST changes
+    GDateTime *tomorrow = g_date_time_add_days(today, 1);
+    gint64 t = g_date_time_to_unix(tomorrow) * G_USEC_PER_SEC;
+    g_date_time_unref(tomorrow);
+    g_date_time_unref(today);
+    return t;
+}
+
+static gint64 next_minute(GDateTime *now) {
+    // Time zone offsets and DST transitions are whole minutes
+    return (g_date_time_to_unix(now) / 60 + 1) * 60 * G_USEC_PER_SEC;
+}
+
+// Centre text laid out with Pango in a w x h area
+static void draw_centered_text(cairo_t *cr, const char *text, double w, double h) {
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    PangoFontDescription *desc = pango_font_description_from_string("Sans Bold");
+    pango_font_description_set_absolute_size(desc, h * 0.7 * PANGO_SCALE);
+    pango_layout_set_font_description(layout, desc);
+    pango_font_description_free(desc);
+    pango_layout_set_text(layout, text, -1);
+
+    int text_w, text_h;
+    pango_layout_get_pixel_size(layout, &text_w, &text_h);
+    cairo_move_to(cr, (w - text_w) / 2.0, (h - text_h) / 2.0);
+    pango_cairo_show_layout(cr, layout);
+    g_object_unref(layout);
+}
+
+static void draw_window_frame(cairo_t *cr, double w, double h) {
+    double line = MAX(h * 0.06, 0.5);
+    cairo_rectangle(cr, line / 2, line / 2, w - line, h - line);
+    cairo_set_source_rgb(cr, 0.97, 0.97, 0.95);
+    cairo_fill_preserve(cr);
+    cairo_set_source_rgba(cr, 0.3, 0.3, 0.3, 0.8);
+    cairo_set_line_width(cr, line);
+    cairo_stroke(cr);
+    cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+}
+
+static gint64 draw_date(cairo_t *cr, double w, double h, GDateTime *now) {
+    char text[8];
+    g_snprintf(text, sizeof(text), "%d", g_date_time_get_day_of_month(now));
+    draw_window_frame(cr, w, h);
+    draw_centered_text(cr, text, w, h);
+    return next_local_midnight(now);
+}
+
+static gint64 draw_weekday(cairo_t *cr, double w, double h, GDateTime *now) {
+    gchar *day = g_date_time_format(now, "%a");
+    gchar *upper = g_utf8_strup(day ? day : "", -1);
+    draw_window_frame(cr, w, h);
+    draw_centered_text(cr, upper, w, h);
+    g_free(upper);
+    g_free(day);
+    return next_local_midnight(now);
+}
+
+static gint64 draw_moon(cairo_t *cr, double w, double h, GDateTime *now) {
+    double r = MIN(w, h) / 2.0 * 0.9;
+    double age = (g_date_time_to_unix(now) - MOON_EPOCH_UNIX) / 86400.0 / MOON_SYNODIC_DAYS;
+    double phase = age - floor(age);  // 0 new, 0.5 full
+
+    cairo_translate(cr, w / 2.0, h / 2.0);
+    cairo_arc(cr, 0, 0, r, 0, 2 * M_PI);
+    cairo_set_source_rgb(cr, 0.12, 0.14, 0.25);
+    cairo_fill(cr);
+
+    // Lit half on the right while waxing, on the left while waning; the
+    // terminator is a half ellipse whose width follows the phase
+    if (phase >= 0.5)
+        cairo_scale(cr, -1.0, 1.0);
+    double k = cos(2 * M_PI * phase);
+    if (fabs(k) < 1e-3)
+        k = 1e-3;
+    cairo_arc(cr, 0, 0, r, -M_PI / 2.0, M_PI / 2.0);
+    cairo_save(cr);
+    cairo_scale(cr, k, 1.0);
+    cairo_arc_negative(cr, 0, 0, r, M_PI / 2.0, -M_PI / 2.0);
+    cairo_restore(cr);
+    cairo_set_source_rgb(cr, 0.98, 0.94, 0.75);
+    cairo_fill(cr);
+
+    return next_local_midnight(now);
+}
+
+static void draw_small_hand(cairo_t *cr, double angle, double length, double width, double r, double g, double b) {
+    cairo_save(cr);
+    cairo_rotate(cr, angle - M_PI / 2.0);
+    cairo_set_source_rgb(cr, r, g, b);
+    cairo_set_line_width(cr, width);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_move_to(cr, 0, 0);
+    cairo_line_to(cr, length, 0);
+    cairo_stroke(cr);
+    cairo_restore(cr);
+}
+
+// 24 hour subdial with noon at the top
+static gint64 draw_24h(cairo_t *cr, double w, double h, GDateTime *now) {
+    double r = MIN(w, h) / 2.0 * 0.95;
+    cairo_translate(cr, w / 2.0, h / 2.0);
+
+    cairo_set_source_rgba(cr, 0.2, 0.2, 0.2, 0.6);
+    cairo_set_line_width(cr, MAX(r * 0.03, 0.5));
+    cairo_arc(cr, 0, 0, r, 0, 2 * M_PI);
+    cairo_stroke(cr);
+    for (int i = 0; i < 24; i++) {
+        double a = i * M_PI / 12.0;
+        double inner = i % 6 ? 0.88 : 0.75;
+        cairo_move_to(cr, cos(a) * r * inner, sin(a) * r * inner);
+        cairo_line_to(cr, cos(a) * r * 0.97, sin(a) * r * 0.97);
+    }
+    cairo_stroke(cr);
+
+    double hours = g_date_time_get_hour(now) + g_date_time_get_minute(now) / 60.0;
+    draw_small_hand(cr, (hours / 24.0) * 2 * M_PI + M_PI, r * 0.85, MAX(r * 0.06, 1.0), 0.1, 0.3, 0.6);
+    return next_minute(now);
+}
+
+// Angle of the second time zone's hour hand, clockwise from 12
+static double tz2_angle(GDateTime *now) {
+    GDateTime *there = g_date_time_to_timezone(now, timezone2_tz);
+    double hours = g_date_time_get_hour(there) % 12 + g_date_time_get_minute(there) / 60.0;
+    g_date_time_unref(there);
+    return hours / 12.0 * 2 * M_PI;
+}
+
+// GMT-style hour hand for the second time zone, spanning the whole dial
+static gint64 draw_tz2(cairo_t *cr, double w, double h, GDateTime *now) {
+    if (!timezone2_tz)
+        return G_MAXINT64;
+
+    double angle = tz2_angle(now);
+    double r = MIN(w, h) / 2.0;
+
+    cairo_translate(cr, w / 2.0, h / 2.0);
+    draw_small_hand(cr, angle, r * 0.55, MAX(r * 0.012, 1.0), 0.85, 0.45, 0.05);
+    // Arrow tip
+    cairo_rotate(cr, angle - M_PI / 2.0);
+    cairo_move_to(cr, r * 0.62, 0);
+    cairo_line_to(cr, r * 0.54, -r * 0.03);
+    cairo_line_to(cr, r * 0.54, r * 0.03);
+    cairo_close_path(cr);
+    cairo_fill(cr);
+    return next_minute(now);
+}
+
+// The tz2 hand from the centre to the arrow tip, plus the round cap
+static void ink_tz2(double w, double h, GDateTime *now, graphene_rect_t *ink) {
+    double r = MIN(w, h) / 2.0;
+    if (!timezone2_tz) {
+        *ink = GRAPHENE_RECT_INIT(w / 2.0, h / 2.0, 0, 0);
+        return;
+    }
+    double angle = tz2_angle(now);
+    double tip_x = w / 2.0 + sin(angle) * r * 0.62, tip_y = h / 2.0 - cos(angle) * r * 0.62;
+    double pad = MAX(r * 0.03, 1.0) + 1.0;
+    double x0 = floor(MIN(w / 2.0, tip_x) - pad), y0 = floor(MIN(h / 2.0, tip_y) - pad);
+    *ink = GRAPHENE_RECT_INIT(x0, y0, ceil(MAX(w / 2.0, tip_x) + pad) - x0, ceil(MAX(h / 2.0, tip_y) + pad) - y0);
+}
+
+// The windows sit at 3 and 9 o'clock and the moon at 6 like on a plain watch;
+// with the chronograph subdials in those places they move to the diagonals
+static Complication clock_complications[N_COMPLICATIONS] = {
+    {.name = "date", .x = 0.66, .y = 0.46, .w = 0.12, .h = 0.08, .chrono_x = 0.64, .chrono_y = 0.66,
+     .draw = draw_date},
+    {.name = "weekday", .x = 0.20, .y = 0.46, .w = 0.16, .h = 0.08, .chrono_x = 0.22, .chrono_y = 0.66,
+     .draw = draw_weekday},
+    {.name = "moon", .x = 0.43, .y = 0.62, .w = 0.14, .h = 0.14, .chrono_x = 0.23, .chrono_y = 0.23,
+     .draw = draw_moon},
+    {.name = "24h", .x = 0.41, .y = 0.21, .w = 0.18, .h = 0.18, .chrono_x = 0.41, .chrono_y = 0.21,
+     .draw = draw_24h},
+    {.name = "tz2", .x = 0.0, .y = 0.0, .w = 1.0, .h = 1.0, .chrono_x = 0.0, .chrono_y = 0.0, .draw = draw_tz2,
+     .ink = ink_tz2},
+};
+
+// Enable the complications named in the comma-separated complications setting
+static void setup_complications(void) {
+    gchar **names = g_strsplit(complications ? complications : "", ",", -1);
+    for (gchar **name = names; *name; name++) {
+        g_strstrip(*name);
+        if (!**name)
+            continue;
+        gboolean found = FALSE;
+        for (size_t i = 0; i < G_N_ELEMENTS(clock_complications); i++) {
+            if (!strcmp(*name, clock_complications[i].name)) {
+                clock_complications[i].enabled = TRUE;
+                found = TRUE;
+            }
+        }
+        if (!found)
+            g_printerr("Unknown complication %s\n", *name);
+    }
+    g_strfreev(names);
+
+    if (timezone2 && *timezone2) {
+        timezone2_tz = g_time_zone_new_identifier(timezone2);
+        if (!timezone2_tz)
+            g_printerr("Unknown time zone %s\n", timezone2);
+    }
+}
+
+// Render comp for now into tex and set where it goes
+static void render_complication(const Complication *comp, ComplicationTexture *tex, int width, int height, int scale,
+                                GDateTime *now) {
+    double w = comp->w * width, h = comp->h * height;
+    graphene_rect_t ink = GRAPHENE_RECT_INIT(0, 0, w, h);
+    if (comp->ink)
+        comp->ink(w, h, now, &ink);
+    int device_w = (int)ceil(ink.size.width * scale), device_h = (int)ceil(ink.size.height * scale);
+    gboolean moved = chronograph_mode;
+    tex->rect = GRAPHENE_RECT_INIT((moved ? comp->chrono_x : comp->x) * width + ink.origin.x,
+                                   (moved ? comp->chrono_y : comp->y) * height + ink.origin.y,
+                                   device_w / (double)scale, device_h / (double)scale);
+    tex->w = width;
+    tex->h = height;
+    tex->scale = scale;
+    g_clear_object(&tex->texture);
+
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, MAX(device_w, 1), MAX(device_h, 1));
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        tex->next_change = G_MAXINT64;
+        return;
+    }
+    cairo_t *cr = cairo_create(surface);
+    cairo_scale(cr, scale, scale);
+    cairo_translate(cr, -ink.origin.x, -ink.origin.y);
+    tex->next_change = comp->draw(cr, w, h, now);
+    cairo_destroy(cr);
+    tex->texture = texture_from_surface(surface);
+}
+
+static void snapshot_complications(ClockView *view, GtkSnapshot *snapshot, int width, int height, int scale) {
+    gint64 now_usec = g_get_real_time();
+    GDateTime *now = NULL;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(clock_complications); i++) {
+        const Complication *comp = &clock_complications[i];
+        ComplicationTexture *tex = &view->complications[i];
+        if (!comp->enabled)
+            continue;
+
+        // Only an integer comparison per frame until the content changes
+        if (!tex->texture || now_usec >= tex->next_change || width != tex->w || height != tex->h ||
+            scale != tex->scale) {
+            if (!now)
+                now = g_date_time_new_from_unix_local(now_usec / G_USEC_PER_SEC);
+            render_complication(comp, tex, width, height, scale, now);
+        }
+
+        if (tex->texture)
+            gtk_snapshot_append_texture(snapshot, tex->texture, &tex->rect);
+    }
+
+    if (now)
+        g_date_time_unref(now);
+}
+
+// Flashing face while an alarm rings and progress arcs for running countdowns;
+// only built while active. The flash is a colour node clipped to a disc, so the
+// pulse costs no rasterization, and the arcs get a node bounded by their ring
+static void snapshot_alarm_indicators(GtkSnapshot *snapshot, int width, int height) {
+    if (!alarm_flash_until && !countdowns_running)
+        return;
+
+    double r = MIN(width, height) / 2.0;
+    gint64 now = g_get_real_time();
+
+    if (alarm_flash_until) {
+        double pulse = 0.5 + 0.5 * cos(2 * M_PI * (now % G_USEC_PER_SEC) / G_USEC_PER_SEC);
+        double disc = r * 0.9;
+        graphene_rect_t area = GRAPHENE_RECT_INIT(width / 2.0 - disc, height / 2.0 - disc, 2 * disc, 2 * disc);
+        GdkRGBA flash = {0.9, 0.1, 0.05, 0.35 * pulse};
+        GskRoundedRect clip;
+        gsk_rounded_rect_init_from_rect(&clip, &area, disc);
+        gtk_snapshot_push_rounded_clip(snapshot, &clip);
+        gtk_snapshot_append_color(snapshot, &flash, &area);
+        gtk_snapshot_pop(snapshot);
+    }
+
+    if (!countdowns_running)
+        return;
+    double line = MAX(r * 0.025, 1.0), ring = r * 0.86;
+    double extent = ring + line;
+    graphene_rect_t bounds =
+        GRAPHENE_RECT_INIT(floor(width / 2.0 - extent), floor(height / 2.0 - extent), ceil(2 * extent) + 1,
+                           ceil(2 * extent) + 1);
+    cairo_t *cr = gtk_snapshot_append_cairo(snapshot, &bounds);
+    cairo_translate(cr, width / 2.0, height / 2.0);
+    cairo_set_line_width(cr, line);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_set_source_rgba(cr, 0.95, 0.55, 0.05, 0.85);
+    for (guint i = 0; clock_alarms && i < clock_alarms->len; i++) {
+        ClockAlarm *alarm = g_ptr_array_index(clock_alarms, i);
+        if (alarm->kind != ALARM_COUNTDOWN || !alarm->source_id || alarm->end <= alarm->start)
+            continue;
+        double left = CLAMP((double)(alarm->end - now) / (alarm->end - alarm->start), 0.0, 1.0);
+        if (left > 0.0) {
+            cairo_new_sub_path(cr);
+            cairo_arc(cr, 0, 0, ring, -M_PI / 2.0, -M_PI / 2.0 + left * 2 * M_PI);
+        }
+    }
+    cairo_stroke(cr);
+    cairo_destroy(cr);
+}
+
+static gboolean overlays_enabled(void) {
+    if (chronograph_mode || (clock_alarms && clock_alarms->len))
+        return TRUE;
+    for (size_t i = 0; i < G_N_ELEMENTS(clock_complications); i++) {
+        if (clock_complications[i].enabled)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void render_pass_clear(RenderPass *pass) {
+    g_clear_object(&pass->texture);
+    g_clear_pointer(&pass->node, gsk_render_node_unref);
+    for (size_t i = 0; i < pass->n_layers; i++) {
+        g_clear_pointer(&pass->layer_nodes[i], gsk_render_node_unref);
+        g_clear_pointer(&pass->prepared_nodes[i], gsk_render_node_unref);
+        g_clear_object(&pass->blur_sprites[i].texture);
+    }
+}
+
+// Build the layer graph from the layers the theme provides: absent layers are
+// left out, runs of static layers are merged into one cached pass and runs of
+// moving layers into one dynamic pass. Cached textures of passes whose layers
+// are unchanged (not in changed) carry over; the others are rendered right
+// away if the size is known, so a reload never shows a blank frame
+static void build_view_passes(ClockView *view, guint32 changed) {
+    RenderPass old[G_N_ELEMENTS(view->passes)];
+    size_t n_old = view->n_passes;
+    memcpy(old, view->passes, sizeof(RenderPass) * n_old);
+    memset(view->passes, 0, sizeof(view->passes));
+    view->n_passes = 0;
+    view->generation = pass_generation;
+
+    gboolean overlays = overlays_enabled();
+    for (size_t i = 0; i < G_N_ELEMENTS(layer_order); i++) {
+        int e = layer_order[i];
+        PassKind kind;
+        RenderLayer layer = {.derive_from = -1};
+
+        if (e == LAYER_OVERLAYS) {
+            if (!overlays)
+                continue;
+            kind = PASS_OVERLAYS;
+        } else {
+            if (!layer_wanted(e) || !layer_present(e))
+                continue;
+            layer.source = e;
+            layer.transform = layer_transform(e);
+            if (layer_is_shadow(e)) {
+                // SHADOW_OFFSET is given in the hands' frame, 12 o'clock along +x
+                layer.offset_x = SHADOW_OFFSET_Y;
+                layer.offset_y = -SHADOW_OFFSET_X;
+            }
+            if (layer.transform != TRANSFORM_STATIC) {
+                int source = layer_hints[e].shadow_of >= 0 ? layer_hints[e].shadow_of : e;
+                RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height}, logical;
+                layer.has_ink = rsvg_handle_get_geometry_for_layer(g_svg_handles[source], NULL, &viewport,
+                                                                   &layer.ink, &logical, NULL);
+            }
+            kind = layer.transform == TRANSFORM_STATIC ? PASS_CACHED : PASS_DYNAMIC;
+        }
+
+        RenderPass *pass = view->n_passes ? &view->passes[view->n_passes - 1] : NULL;
+        if (!pass || pass->kind != kind || kind == PASS_OVERLAYS) {
+            pass = &view->passes[view->n_passes++];
+            pass->kind = kind;
+        }
+        if (kind != PASS_OVERLAYS)
+            pass->layers[pass->n_layers++] = layer;
+    }
+
+    // Derived shadows whose hand is drawn in the same pass copy its node
+    for (size_t i = 0; i < view->n_passes; i++) {
+        RenderPass *pass = &view->passes[i];
+        for (size_t k = 0; pass->kind == PASS_DYNAMIC && k < pass->n_layers; k++) {
+            int source = layer_hints[pass->layers[k].source].shadow_of;
+            for (size_t j = 0; source >= 0 && j < pass->n_layers; j++) {
+                if ((int)pass->layers[j].source == source)
+                    pass->layers[k].derive_from = (int)j;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < view->n_passes; i++) {
+        RenderPass *pass = &view->passes[i];
+        if (pass->kind != PASS_CACHED)
+            continue;
+        for (size_t j = 0; j < n_old; j++) {
+            gboolean dirty = FALSE;
+            for (size_t k = 0; k < old[j].n_layers; k++) {
+                dirty |= (changed & LAYER_BIT(old[j].layers[k].source)) != 0;
+            }
+            if (!dirty && old[j].texture && render_layers_equal(pass, &old[j])) {
+                pass->texture = g_steal_pointer(&old[j].texture);
+                pass->quality = old[j].quality;
+                break;
+            }
+        }
+        if (!pass->texture && view->cache_w && view->cache_h)
+            view_pass_texture(view, i, baked_quality);
+    }
+
+    for (size_t j = 0; j < n_old; j++) {
+        if (old[j].texture)
+            cache_size_stats(view->cache_w * view->cache_scale, view->cache_h * view->cache_scale)->evictions++;
+        render_pass_clear(&old[j]);
+    }
+    view->hands_dirty = TRUE;
+}
+
+static void build_render_passes(guint32 changed) {
+    pass_generation++;
+    for (guint v = 0; v < clock_views->len; v++) {
+        build_view_passes(g_ptr_array_index(clock_views, v), changed);
+    }
+}
+
+// --dump-nodes=DIR[:EVERY_N]: every Nth snapshot of the clock is written to DIR
+// as frame-NNNNNN.node in GTK's render node format (gtk4-node-editor and
+// gtk4-rendernode-tool read it), with a line per dump in DIR/summary.txt
+static gchar *node_dump_dir;
+static guint node_dump_every = 1;
+static guint node_dump_frame;  // snapshots taken since startup
+static FILE *node_dump_summary;
+
+typedef struct {
+    guint nodes;
+    GHashTable *types;     // type name -> count
+    GHashTable *textures;  // set of distinct textures referenced
+    double cairo_area;     // device pixels drawn through cairo fallback nodes
+    guint64 texture_bytes;
+    int scale;
+} NodeSummary;
+
+static void node_summary_texture(NodeSummary *summary, GdkTexture *texture) {
+    if (!g_hash_table_add(summary->textures, texture))
+        return;
+    // Our textures are all GDK_MEMORY_DEFAULT, 4 bytes per pixel
+    summary->texture_bytes += (guint64)gdk_texture_get_width(texture) * gdk_texture_get_height(texture) * 4;
+}
+
+static void node_summary_add(NodeSummary *summary, GskRenderNode *node) {
+    const char *type = g_type_name(G_TYPE_FROM_INSTANCE(node));
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(summary->types, type));
+    g_hash_table_insert(summary->types, (gpointer)type, GUINT_TO_POINTER(count + 1));
+    summary->nodes++;
+
+    graphene_rect_t bounds;
+    switch (gsk_render_node_get_node_type(node)) {
+    case GSK_CAIRO_NODE:
+        gsk_render_node_get_bounds(node, &bounds);
+        summary->cairo_area += bounds.size.width * bounds.size.height * summary->scale * summary->scale;
+        break;
+    case GSK_TEXTURE_NODE:
+        node_summary_texture(summary, gsk_texture_node_get_texture(node));
+        break;
+    case GSK_CONTAINER_NODE:
+        for (guint i = 0; i < gsk_container_node_get_n_children(node); i++) {
+            node_summary_add(summary, gsk_container_node_get_child(node, i));
+        }
+        break;
+    case GSK_TRANSFORM_NODE:
+        node_summary_add(summary, gsk_transform_node_get_child(node));
+        break;
+    case GSK_OPACITY_NODE:
+        node_summary_add(summary, gsk_opacity_node_get_child(node));
+        break;
+    case GSK_COLOR_MATRIX_NODE:
+        node_summary_add(summary, gsk_color_matrix_node_get_child(node));
+        break;
+    case GSK_REPEAT_NODE:
+        node_summary_add(summary, gsk_repeat_node_get_child(node));
+        break;
+    case GSK_CLIP_NODE:
+        node_summary_add(summary, gsk_clip_node_get_child(node));
+        break;
+    case GSK_ROUNDED_CLIP_NODE:
+        node_summary_add(summary, gsk_rounded_clip_node_get_child(node));
+        break;
+    case GSK_SHADOW_NODE:
+        node_summary_add(summary, gsk_shadow_node_get_child(node));
+        break;
+    case GSK_BLUR_NODE:
+        node_summary_add(summary, gsk_blur_node_get_child(node));
+        break;
+    case GSK_DEBUG_NODE:
+        node_summary_add(summary, gsk_debug_node_get_child(node));
+        break;
+    case GSK_BLEND_NODE:
+        node_summary_add(summary, gsk_blend_node_get_bottom_child(node));
+        node_summary_add(summary, gsk_blend_node_get_top_child(node));
+        break;
+    case GSK_CROSS_FADE_NODE:
+        node_summary_add(summary, gsk_cross_fade_node_get_start_child(node));
+        node_summary_add(summary, gsk_cross_fade_node_get_end_child(node));
+        break;
+#if GTK_CHECK_VERSION(4, 10, 0)
+    case GSK_TEXTURE_SCALE_NODE:
+        node_summary_texture(summary, gsk_texture_scale_node_get_texture(node));
+        break;
+    case GSK_MASK_NODE:
+        node_summary_add(summary, gsk_mask_node_get_source(node));
+        node_summary_add(summary, gsk_mask_node_get_mask(node));
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+static gint compare_type_names(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void dump_render_node(GskRenderNode *node, guint frame, int scale) {
+    GError *err = NULL;
+    if (!node_dump_summary) {
+        gchar *path = g_build_filename(node_dump_dir, "summary.txt", NULL);
+        if (g_mkdir_with_parents(node_dump_dir, 0755) == 0)
+            node_dump_summary = g_fopen(path, "w");
+        if (!node_dump_summary) {
+            g_printerr("Cannot write %s: %s\n", path, g_strerror(errno));
+            g_clear_pointer(&node_dump_dir, g_free);  // don't retry every frame
+        }
+        g_free(path);
+        if (!node_dump_summary)
+            return;
+    }
+
+    gchar *name = g_strdup_printf("frame-%06u.node", frame);
+    gchar *path = g_build_filename(node_dump_dir, name, NULL);
+    GBytes *bytes = gsk_render_node_serialize(node);
+    if (!g_file_set_contents(path, g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes), &err)) {
+        g_printerr("Cannot write %s: %s\n", path, err->message);
+        g_clear_error(&err);
+    }
+    g_bytes_unref(bytes);
+    g_free(path);
+
+    NodeSummary summary = {
+        .types = g_hash_table_new(g_str_hash, g_str_equal),
+        .textures = g_hash_table_new(NULL, NULL),
+        .scale = scale,
+    };
+    node_summary_add(&summary, node);
+
+    // Sorted by type name so summaries of different versions diff cleanly
+    guint n_types;
+    const char **types = (const char **)g_hash_table_get_keys_as_array(summary.types, &n_types);
+    qsort(types, n_types, sizeof(*types), compare_type_names);
+    fprintf(node_dump_summary, "%s: %u nodes (", name, summary.nodes);
+    for (guint i = 0; i < n_types; i++) {
+        fprintf(node_dump_summary, "%s%s %u", i ? ", " : "", types[i],
+                GPOINTER_TO_UINT(g_hash_table_lookup(summary.types, types[i])));
+    }
+    fprintf(node_dump_summary, "), cairo %.0f px, %u textures %" G_GUINT64_FORMAT " bytes\n", summary.cairo_area,
+            g_hash_table_size(summary.textures), summary.texture_bytes);
+    fflush(node_dump_summary);
+
+    g_free(types);
+    g_hash_table_unref(summary.types);
+    g_hash_table_unref(summary.textures);
+    g_free(name);
+}
+
+static gboolean on_dump_nodes_option(const gchar *option_name, const gchar *value, gpointer data, GError **error) {
+    const char *colon = strrchr(value, ':');
+    guint64 every = 1;
+
+    // A trailing :N that is not a number is part of the directory name
+    g_free(node_dump_dir);
+    if (colon && g_ascii_string_to_unsigned(colon + 1, 10, 1, G_MAXUINT, &every, NULL))
+        node_dump_dir = g_strndup(value, colon - value);
+    else
+        node_dump_dir = g_strdup(value);
+    if (!*node_dump_dir) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "No directory given to %s", option_name);
+        return FALSE;
+    }
+    node_dump_every = (guint)every;
+    return TRUE;
+}
+
+// Custom widget snapshot function - walks the layer graph of the widget's view
+static void clock_widget_snapshot(GtkWidget *widget, GtkSnapshot *snapshot) {
+    ClockView *view = CLOCK_WIDGET(widget)->view;
+    int width = gtk_widget_get_width(widget);
+    int height = gtk_widget_get_height(widget);
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    // A frame being dumped is drawn into its own snapshot so its node tree can
+    // be serialized before it is handed on
+    GtkSnapshot *target = snapshot;
+    gboolean dump = node_dump_dir && node_dump_frame % node_dump_every == 0;
+    guint dump_frame = node_dump_frame++;
+    if (dump)
+        snapshot = gtk_snapshot_new();
+
+    gint64 frame_start = g_get_monotonic_time();
+    metrics.frames_drawn++;
+    metrics.hz_window_frames++;
+    if (frame_start - metrics.hz_window_start >= G_USEC_PER_SEC) {
+        metrics.effective_hz =
+            metrics.hz_window_frames * (double)G_USEC_PER_SEC / (frame_start - metrics.hz_window_start);
+        metrics.hz_window_start = frame_start;
+        metrics.hz_window_frames = 0;
+    }
+
+    // Ensure the cached pass textures are ready
+    gboolean first_frame = !view->cache_w;
+    ensure_layer_caches(view, width, height);
+    if (first_frame)
+        startup_mark("layer-caches", NULL);
+
+    graphene_rect_t bounds = GRAPHENE_RECT_INIT(0, 0, width, height);
+
+    // Night mode and accent tint are applied to the cached layers by GSK
+    struct timespec ts;
+    gboolean fading;
+    graphene_matrix_t face_matrix, hands_matrix;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    gboolean tinted = night_color_matrices(night_factor(&ts, &fading), &face_matrix, &hands_matrix);
+    graphene_vec4_t no_offset;
+    graphene_vec4_init(&no_offset, 0, 0, 0, 0);
+
+    for (size_t i = 0; i < view->n_passes; i++) {
+        RenderPass *pass = &view->passes[i];
+
+        switch (pass->kind) {
+        case PASS_CACHED:
+            // Cached texture of static layers in a retained node (fast!)
+            if (!pass->texture)
+                break;
+            if (!pass->node || cached_node_texture(pass->node) != pass->texture || width != pass->node_w ||
+                height != pass->node_h) {
+                g_clear_pointer(&pass->node, gsk_render_node_unref);
+                pass->node = cached_pass_node(pass, &bounds, width * gtk_widget_get_scale_factor(widget));
+                pass->node_w = width;
+                pass->node_h = height;
+                node_stats.built++;
+            } else {
+                node_stats.reused++;
+            }
+            if (tinted)
+                gtk_snapshot_push_color_matrix(snapshot, &face_matrix, &no_offset);
+            gtk_snapshot_append_node(snapshot, pass->node);
+            if (tinted)
+                gtk_snapshot_pop(snapshot);
+            break;
+
+        case PASS_OVERLAYS:
+            if (tinted)
+                gtk_snapshot_push_color_matrix(snapshot, &face_matrix, &no_offset);
+            snapshot_complications(view, snapshot, width, height, gtk_widget_get_scale_factor(widget));
+            if (chronograph_mode) {
+                snapshot_chrono_subdials(view, snapshot, width, height, gtk_widget_get_scale_factor(widget));
+            }
+            if (tinted)
+                gtk_snapshot_pop(snapshot);
+            snapshot_alarm_indicators(snapshot, width, height);
+            break;
+
+        case PASS_DYNAMIC:
+            if (view->hands_dirty || !pass->node || width != pass->node_w || height != pass->node_h)
+                update_dynamic_pass(pass, width, height, gtk_widget_get_scale_factor(widget),
+                                    view->scheduler.sweep_interval, view->cache_settle_id != 0);
+            else
+                node_stats.reused += pass->n_layers;
+            if (tinted)
+                gtk_snapshot_push_color_matrix(snapshot, &hands_matrix, &no_offset);
+            gtk_snapshot_append_node(snapshot, pass->node);
+            if (tinted)
+                gtk_snapshot_pop(snapshot);
+            break;
+        }
+    }
+    view->hands_dirty = FALSE;
+
+    if (dump) {
+        GskRenderNode *node = gtk_snapshot_free_to_node(snapshot);
+        if (node) {
+            dump_render_node(node, dump_frame, gtk_widget_get_scale_factor(widget));
+            gtk_snapshot_append_node(target, node);
+            gsk_render_node_unref(node);
+        }
+    }
+
+    if (first_frame && startup_marks && view == startup_view)
+        startup_first_snapshot(widget);
+}
+
+static void clock_widget_measure(GtkWidget *widget, GtkOrientation orientation, int for_size, int *minimum,
+                                 int *natural, int *minimum_baseline, int *natural_baseline) {
+    *minimum = 100;
+    *natural = 400;
+}
+
+static void clock_widget_class_init(ClockWidgetClass *klass) {
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+    widget_class->snapshot = clock_widget_snapshot;
+    widget_class->measure = clock_widget_measure;
+}
+
+static void clock_widget_init(ClockWidget *self) {
+    gtk_widget_set_hexpand(GTK_WIDGET(self), TRUE);
+    gtk_widget_set_vexpand(GTK_WIDGET(self), TRUE);
+}
+
+static GtkWidget *clock_widget_new(ClockView *view) {
+    ClockWidget *self = g_object_new(CLOCK_TYPE_WIDGET, NULL);
+    self->view = view;
+    view->widget = GTK_WIDGET(self);
+    return view->widget;
+}
+
+// Make view live, with its layer graph built for the current theme
+static void clock_view_attach(ClockView *view) {
+    g_ptr_array_add(clock_views, view);
+    build_view_passes(view, 0);
+}
+
+// Drop the caches and pending callbacks of a view whose window is gone; its
+// tick callback went with the widget
+static void clock_view_detach(ClockView *view) {
+    g_ptr_array_remove(clock_views, view);
+    if (view == startup_view)
+        startup_view = NULL;
+    if (view->resume_id)
+        g_source_remove(view->resume_id);
+    if (view->cache_settle_id)
+        g_source_remove(view->cache_settle_id);
+    if (view->prepare_id)
+        g_source_remove(view->prepare_id);
+    for (size_t i = 0; i < view->n_passes; i++) {
+        render_pass_clear(&view->passes[i]);
+    }
+    for (size_t i = 0; i < G_N_ELEMENTS(view->complications); i++) {
+        g_clear_object(&view->complications[i].texture);
+    }
+    for (size_t i = 0; i < G_N_ELEMENTS(view->subdials); i++) {
+        subdial_clear(&view->subdials[i]);
+    }
+    view->n_passes = 0;
+    view->widget = NULL;
+    view->tick_id = view->resume_id = view->cache_settle_id = view->prepare_id = 0;
+    view->cache_w = view->cache_h = view->cache_scale = 0;
+}
+
+// Headless output for e-paper and low-cost LCD panels (--output): frames are
+// composited with cairo from the cached static layers and the hands, converted
+// to a low-bit-depth format and written together with the rectangles that
+// changed since the previous frame. The rectangles come from the hands' old and
+// new bounding boxes, so a minute step touches a few small areas rather than
+// the whole panel, and only those areas are recomposited and converted.
+//
+// A mapped target, a file or shm:NAME (/dev/shm/NAME), holds an OutputHeader
+// followed by the whole frame, updated in place; sequence is odd while a frame
+// is being written. A stream target, "-" for stdout or a FIFO, gets a record
+// per frame: a line "CLOK4 FORMAT WIDTH HEIGHT N", N lines "X Y W H", then the
+// pixels of each rectangle row by row. Rectangles are aligned to 8 pixels
+// horizontally, so 1-bit rows are whole bytes (most significant bit first,
+// 1 for white); RGB565 is little-endian
+#define OUTPUT_MAX_RECTS 16
+#define OUTPUT_MAGIC     "CLOK4FB"
+
 typedef enum {
-    CLOCK_DROP_SHADOW = 0,
-    CLOCK_FACE,
-    CLOCK_MARKS,
-    CLOCK_HOUR_HAND_SHADOW,
-    CLOCK_MINUTE_HAND_SHADOW,
-    CLOCK_SECOND_HAND_SHADOW,
-    CLOCK_HOUR_HAND,
-    CLOCK_MINUTE_HAND,
-    CLOCK_SECOND_HAND,
-    CLOCK_FACE_SHADOW,
-    CLOCK_GLASS,
-    CLOCK_FRAME,
-    CLOCK_ELEMENTS
-} LayerElement;
+    OUTPUT_RGB565 = 0,
+    OUTPUT_GRAY8,
+    OUTPUT_MONO_ORDERED,   // 8x8 Bayer dither
+    OUTPUT_MONO_DIFFUSE,   // Floyd-Steinberg, confined to each rectangle
+} OutputFormat;
+
+static const char *const output_format_names[] = {"rgb565", "gray8", "mono-ordered", "mono-diffuse"};
+
+typedef struct {
+    int x, y, w, h;
+} OutputRect;
+
+typedef struct {
+    char magic[8];
+    guint32 format;  // OutputFormat
+    guint32 width, height, stride;
+    gint sequence;
+    guint32 n_rects;
+    guint32 rects[OUTPUT_MAX_RECTS][4];  // x, y, width, height of the changed areas
+} OutputHeader;
+
+static gchar *output_target;  // NULL for a window
+static gchar *output_format_name;
+
+static struct {
+    OutputFormat format;
+    int width, height, stride;
+    cairo_surface_t *frame;  // composited frame, opaque ARGB32
+    cairo_surface_t *cached[G_N_ELEMENTS(main_view.passes)];  // PASS_CACHED rasters
+    guchar *pixels;          // converted frame
+    OutputHeader *header;    // mapped targets
+    gsize map_size;
+    int fd;
+    gboolean stream;
+    gboolean drawn;
+    GMainLoop *loop;
+} output = {.fd = -1};
+
+static int output_stride(OutputFormat format, int width) {
+    switch (format) {
+    case OUTPUT_RGB565:
+        return width * 2;
+    case OUTPUT_GRAY8:
+        return width;
+    default:
+        return (width + 7) / 8;
+    }
+}
+
+// Add r to rects, merging rectangles that overlap; past OUTPUT_MAX_RECTS
+// everything collapses into the bounding box
+static void output_add_rect(OutputRect *rects, int *n, OutputRect r) {
+    // Whole bytes for 1-bit rows
+    int x1 = MIN((r.x + r.w + 7) & ~7, output.width);
+    r.x = MAX(r.x & ~7, 0);
+    r.w = x1 - r.x;
+    r.h = MIN(r.y + r.h, output.height) - MAX(r.y, 0);
+    r.y = MAX(r.y, 0);
+    if (r.w <= 0 || r.h <= 0)
+        return;
+
+    for (int i = 0; i < *n;) {
+        OutputRect *o = &rects[i];
+        if (r.x <= o->x + o->w && o->x <= r.x + r.w && r.y <= o->y + o->h && o->y <= r.y + r.h) {
+            int rx1 = MAX(r.x + r.w, o->x + o->w), ry1 = MAX(r.y + r.h, o->y + o->h);
+            r.x = MIN(r.x, o->x);
+            r.y = MIN(r.y, o->y);
+            r.w = rx1 - r.x;
+            r.h = ry1 - r.y;
+            rects[i] = rects[--*n];
+            i = 0;  // the grown rectangle may now touch one already checked
+        } else {
+            i++;
+        }
+    }
+    if (*n == OUTPUT_MAX_RECTS) {
+        for (int i = 0; i < *n; i++) {
+            int rx1 = MAX(r.x + r.w, rects[i].x + rects[i].w), ry1 = MAX(r.y + r.h, rects[i].y + rects[i].h);
+            r.x = MIN(r.x, rects[i].x);
+            r.y = MIN(r.y, rects[i].y);
+            r.w = rx1 - r.x;
+            r.h = ry1 - r.y;
+        }
+        *n = 0;
+    }
+    rects[(*n)++] = r;
+}
+
+// Recomposite the frame within rect: white background, cached layers, hands
+static void output_composite(const OutputRect *rect) {
+    int width = output.width, height = output.height;
+    RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+    cairo_t *cr = cairo_create(output.frame);
+
+    cairo_rectangle(cr, rect->x, rect->y, rect->w, rect->h);
+    cairo_clip(cr);
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_paint(cr);
+
+    for (size_t i = 0; i < main_view.n_passes; i++) {
+        RenderPass *pass = &main_view.passes[i];
+        if (pass->kind == PASS_CACHED && output.cached[i]) {
+            cairo_save(cr);
+            // Rasters made larger by a min-size hint are scaled down
+            cairo_scale(cr, (double)width / cairo_image_surface_get_width(output.cached[i]),
+                        (double)height / cairo_image_surface_get_height(output.cached[i]));
+            cairo_set_source_surface(cr, output.cached[i], 0, 0);
+            cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+            cairo_paint(cr);
+            cairo_restore(cr);
+        } else if (pass->kind == PASS_DYNAMIC) {
+            for (size_t k = 0; k < pass->n_layers; k++) {
+                const RenderLayer *layer = &pass->layers[k];
+                cairo_save(cr);
+                cairo_translate(cr, width / 2.0, height / 2.0);
+                cairo_scale(cr, (double)width / theme_width, (double)height / theme_height);
+                cairo_translate(cr, layer->offset_x, layer->offset_y);
+                cairo_rotate(cr, -M_PI / 2.0);
+                render_hand_layer(cr, layer->source, &layer_hints[layer->source], pass->layer_angles[k], &viewport);
+                cairo_restore(cr);
+            }
+        }
+    }
+    cairo_destroy(cr);
+}
+
+static const guint8 bayer8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42}, {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38}, {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41}, {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37}, {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+static void output_set_bit(guchar *row, int x, gboolean white) {
+    if (white)
+        row[x / 8] |= 0x80 >> (x % 8);
+    else
+        row[x / 8] &= ~(0x80 >> (x % 8));
+}
+
+// Convert the composited frame within rect into output.pixels
+static void output_convert(const OutputRect *rect) {
+    cairo_surface_flush(output.frame);
+    const guchar *src = cairo_image_surface_get_data(output.frame);
+    int src_stride = cairo_image_surface_get_stride(output.frame);
+    int *error = NULL, *next = NULL;
+
+    if (output.format == OUTPUT_MONO_DIFFUSE) {
+        error = g_new0(int, rect->w + 2);
+        next = g_new0(int, rect->w + 2);
+    }
+
+    for (int y = rect->y; y < rect->y + rect->h; y++) {
+        const guint32 *in = (const guint32 *)(src + y * src_stride);
+        guchar *out = output.pixels + y * output.stride;
+        for (int x = rect->x; x < rect->x + rect->w; x++) {
+            // Opaque, so the premultiplied channels are the colour
+            guint32 p = in[x];
+            int r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+            int grey = (r * 77 + g * 150 + b * 29) >> 8;
+            switch (output.format) {
+            case OUTPUT_RGB565: {
+                guint16 v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                out[x * 2] = v & 0xff;
+                out[x * 2 + 1] = v >> 8;
+                break;
+            }
+            case OUTPUT_GRAY8:
+                out[x] = grey;
+                break;
+            case OUTPUT_MONO_ORDERED:
+                output_set_bit(out, x, grey > bayer8[y & 7][x & 7] * 4 + 2);
+                break;
+            case OUTPUT_MONO_DIFFUSE: {
+                int i = x - rect->x + 1;
+                int value = grey + error[i] / 16;
+                int quantized = value >= 128 ? 255 : 0;
+                int e = value - quantized;
+                output_set_bit(out, x, quantized);
+                error[i + 1] += e * 7;
+                next[i - 1] += e * 3;
+                next[i] += e * 5;
+                next[i + 1] += e;
+                break;
+            }
+            }
+        }
+        if (error) {
+            int *t = error;
+            error = next;
+            next = t;
+            memset(next, 0, sizeof(int) * (rect->w + 2));
+        }
+    }
+    g_free(error);
+    g_free(next);
+}
+
+static gboolean write_all(int fd, const void *data, gsize size) {
+    const guchar *p = data;
+    while (size) {
+        gssize n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        p += n;
+        size -= n;
+    }
+    return TRUE;
+}
+
+// Publish the rectangles converted into output.pixels. A mapped target's
+// sequence was made odd before the conversion and becomes even here
+static gboolean output_emit(const OutputRect *rects, int n) {
+    if (!output.stream) {
+        output.header->n_rects = n;
+        for (int i = 0; i < n; i++) {
+            output.header->rects[i][0] = rects[i].x;
+            output.header->rects[i][1] = rects[i].y;
+            output.header->rects[i][2] = rects[i].w;
+            output.header->rects[i][3] = rects[i].h;
+        }
+        g_atomic_int_inc(&output.header->sequence);
+        return TRUE;
+    }
+
+    GString *head = g_string_new(NULL);
+    g_string_append_printf(head, "CLOK4 %s %d %d %d\n", output_format_names[output.format], output.width,
+                           output.height, n);
+    for (int i = 0; i < n; i++) {
+        g_string_append_printf(head, "%d %d %d %d\n", rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+    }
+    gboolean ok = write_all(output.fd, head->str, head->len);
+    g_string_free(head, TRUE);
+
+    for (int i = 0; ok && i < n; i++) {
+        int x0 = output_stride(output.format, rects[i].x);
+        int row = output_stride(output.format, rects[i].x + rects[i].w) - x0;
+        for (int y = rects[i].y; ok && y < rects[i].y + rects[i].h; y++) {
+            ok = write_all(output.fd, output.pixels + y * output.stride + x0, row);
+        }
+    }
+    return ok;
+}
+
+// Draw the clock at realtime ts and emit whatever changed
+static gboolean output_frame(const struct timespec *ts) {
+    OutputRect rects[OUTPUT_MAX_RECTS];
+    int n = 0;
+    HandAngles angles;
+    compute_hand_angles(ts, &angles);
+
+    for (size_t i = 0; i < main_view.n_passes; i++) {
+        RenderPass *pass = &main_view.passes[i];
+        for (size_t k = 0; pass->kind == PASS_DYNAMIC && k < pass->n_layers; k++) {
+            const RenderLayer *layer = &pass->layers[k];
+            double angle = transform_angle(&angles, layer->transform);
+            if (output.drawn && angle == pass->layer_angles[k])
+                continue;
+            graphene_rect_t before = hand_layer_bounds(layer, pass->layer_angles[k], output.width, output.height);
+            graphene_rect_t after = hand_layer_bounds(layer, angle, output.width, output.height);
+            output_add_rect(rects, &n, (OutputRect){before.origin.x, before.origin.y, before.size.width,
+                                                    before.size.height});
+            output_add_rect(rects, &n, (OutputRect){after.origin.x, after.origin.y, after.size.width,
+                                                    after.size.height});
+            pass->layer_angles[k] = angle;
+        }
+    }
+    if (!output.drawn) {
+        n = 0;
+        output_add_rect(rects, &n, (OutputRect){0, 0, output.width, output.height});
+        output.drawn = TRUE;
+    }
+
+    // A mapped target is converted in place, so readers must see the frame as
+    // being written from the first converted pixel until the rects are updated
+    if (n && !output.stream)
+        g_atomic_int_inc(&output.header->sequence);
+    for (int i = 0; i < n; i++) {
+        output_composite(&rects[i]);
+        output_convert(&rects[i]);
+    }
+    metrics.frames_drawn++;
+    return !n || output_emit(rects, n);
+}
+
+// Frames are drawn on whole intervals of the wall clock: each minute without
+// seconds, which suits a panel taking seconds per refresh, else at refresh_rate
+static gboolean on_output_timer(gpointer user_data) {
+    gint64 interval = dont_show_seconds ? 60 * G_USEC_PER_SEC : G_USEC_PER_SEC / refresh_rate;
+    gint64 now = g_get_real_time();
+    gint64 shown = now - now % interval;
+    struct timespec ts = {shown / G_USEC_PER_SEC, shown % G_USEC_PER_SEC * 1000};
+
+    metrics.wakeups++;
+    if (!output_frame(&ts)) {
+        g_printerr("Cannot write to %s: %s\n", output_target, g_strerror(errno));
+        g_main_loop_quit(output.loop);
+        return G_SOURCE_REMOVE;
+    }
+    g_timeout_add((guint)((shown + interval - g_get_real_time() + 999) / 1000), on_output_timer, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_output_signal(gpointer user_data) {
+    g_main_loop_quit(output.loop);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean output_open(void) {
+    GStatBuf st;
+    output.stream = !strcmp(output_target, "-") || (g_stat(output_target, &st) == 0 && S_ISFIFO(st.st_mode));
+    if (output.stream) {
+        output.fd = strcmp(output_target, "-") ? g_open(output_target, O_WRONLY | O_CLOEXEC, 0) : STDOUT_FILENO;
+        output.pixels = g_malloc0((gsize)output.stride * output.height);
+        return output.fd != -1;
+    }
+
+    if (g_str_has_prefix(output_target, "shm:")) {
+        gchar *name = g_strconcat("/", output_target + 4, NULL);
+        output.fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        g_free(name);
+    } else {
+        output.fd = g_open(output_target, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (output.fd == -1)
+        return FALSE;
+
+    // Pixels start on a 64 byte boundary after the header
+    gsize offset = (sizeof(OutputHeader) + 63) & ~(gsize)63;
+    output.map_size = offset + (gsize)output.stride * output.height;
+    if (ftruncate(output.fd, output.map_size) == -1)
+        return FALSE;
+    void *map = mmap(NULL, output.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, output.fd, 0);
+    if (map == MAP_FAILED)
+        return FALSE;
+
+    output.header = map;
+    memset(output.header, 0, sizeof(OutputHeader));
+    memcpy(output.header->magic, OUTPUT_MAGIC, sizeof(OUTPUT_MAGIC));
+    output.header->format = output.format;
+    output.header->width = output.width;
+    output.header->height = output.height;
+    output.header->stride = output.stride;
+    output.pixels = (guchar *)map + offset;
+    return TRUE;
+}
+
+static void output_close(void) {
+    for (size_t i = 0; i < G_N_ELEMENTS(output.cached); i++) {
+        g_clear_pointer(&output.cached[i], cairo_surface_destroy);
+    }
+    g_clear_pointer(&output.frame, cairo_surface_destroy);
+    if (output.header)
+        munmap(output.header, output.map_size);
+    else
+        g_free(output.pixels);
+    if (output.fd > STDOUT_FILENO)
+        close(output.fd);
+}
+
+// Run without a window until interrupted; returns the exit status
+static int run_output(void) {
+    output.format = G_N_ELEMENTS(output_format_names);
+    for (size_t i = 0; i < G_N_ELEMENTS(output_format_names); i++) {
+        if (!g_strcmp0(output_format_name ? output_format_name : "mono-ordered", output_format_names[i]))
+            output.format = i;
+    }
+    if (output.format == G_N_ELEMENTS(output_format_names)) {
+        g_printerr("Unknown output format %s, expected rgb565, gray8, mono-ordered or mono-diffuse\n",
+                   output_format_name);
+        return 1;
+    }
+    output.width = clock_width;
+    output.height = clock_height;
+    output.stride = output_stride(output.format, output.width);
+
+    load_all_svgs();
+    clock_view_attach(&main_view);
+    output.frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, output.width, output.height);
+    for (size_t i = 0; i < main_view.n_passes; i++) {
+        if (main_view.passes[i].kind == PASS_CACHED)
+            output.cached[i] = render_pass_surface(&main_view.passes[i], output.width, output.height, baked_quality);
+    }
+
+    int status = 0;
+    if (output_open()) {
+        output.loop = g_main_loop_new(NULL, FALSE);
+        g_unix_signal_add(SIGINT, on_output_signal, NULL);
+        g_unix_signal_add(SIGTERM, on_output_signal, NULL);
+        on_output_timer(NULL);
+        g_main_loop_run(output.loop);
+        g_main_loop_unref(output.loop);
+    } else {
+        g_printerr("Cannot open output %s: %s\n", output_target, g_strerror(errno));
+        status = 1;
+    }
+    output_close();
+    return status;
+}
+
+// Theme hot reload: layers are parsed by a worker thread, then only the cache
+// groups containing changed layers are re-rasterized and swapped in, so the old
+// textures stay on screen until the new ones are ready. A theme switch (full
+// load) supersedes older switches; loads of some layers of the current theme
+// never supersede anything, and while a switch is pending they are deferred
+// until it is done, then made from whichever theme it left in place
+#define THEME_RELOAD_DELAY_MS 250
+
+typedef struct {
+    gchar *theme_name;
+    gboolean user;
+    gboolean full;  // switching themes rather than reloading changed files
+    guint32 mask;   // layers to load
+    guint serial;   // full loads: theme_switch_serial when started
+    RsvgHandle *handles[CLOCK_ELEMENTS];
+    GPtrArray *rasters[CLOCK_ELEMENTS];
+    LayerHints hints[CLOCK_ELEMENTS];
+} ThemeLoad;
+
+static guint theme_switch_serial;
+static gboolean theme_switch_pending;
+static guint32 theme_deferred_mask;  // layers to load once the pending switch is done
+static GFileMonitor *theme_monitor = NULL;
+static guint32 theme_changed_mask;
+static guint theme_reload_id;
+
+static void watch_theme_dir(void);
+
+static void theme_load_free(gpointer data) {
+    ThemeLoad *load = data;
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        g_clear_object(&load->handles[e]);
+        g_clear_pointer(&load->rasters[e], g_ptr_array_unref);
+    }
+    g_free(load->theme_name);
+    g_free(load);
+}
+
+static void theme_load_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    ThemeLoad *load = task_data;
+    gchar *dir = theme_dir_path(load->theme_name, load->user);
+
+    parse_theme_manifest(dir, load->hints);
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if (!(load->mask & LAYER_BIT(e)) || load->hints[e].shadow_of >= 0)
+            continue;
+        if (hints_transform(e, &load->hints[e]) == TRANSFORM_STATIC)
+            load->rasters[e] = theme_find_rasters(dir, layer_files[e].file);
+        if (load->rasters[e])
+            continue;
+        GError *err = NULL;
+        load->handles[e] = theme_load_svg(dir, layer_files[e].file, &err);
+        if (!load->handles[e] && (layer_files[e].needed || !g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT)))
+            g_warning("Cannot load SVG from %s/%s: %s", dir, layer_files[e].file, err ? err->message : "unknown error");
+        g_clear_error(&err);
+    }
+
+    g_free(dir);
+    g_task_return_boolean(task, TRUE);
+}
+
+static void start_theme_load(const char *theme_name, gboolean user, gboolean full, guint32 mask);
+
+static gboolean theme_load_complete(const ThemeLoad *load) {
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if ((load->mask & LAYER_BIT(e)) && layer_files[e].needed && !load->handles[e] && !load->rasters[e]) {
+            g_printerr("Theme %s is incomplete, keeping %s\n", load->theme_name, theme);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void apply_theme_load(ThemeLoad *load) {
+    guint32 changed = 0;
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if (!layer_hints_equal(&layer_hints[e], &load->hints[e]))
+            changed |= LAYER_BIT(e);
+        layer_hints[e] = load->hints[e];
+        if (!(load->mask & LAYER_BIT(e)))
+            continue;
+        // A required layer that is briefly missing while being saved keeps its old version
+        if (!load->handles[e] && !load->rasters[e] && layer_files[e].needed)
+            continue;
+        g_clear_object(&g_svg_handles[e]);
+        g_svg_handles[e] = g_steal_pointer(&load->handles[e]);
+        layer_raster_clear(&layer_rasters[e]);
+        layer_rasters[e].assets = g_steal_pointer(&load->rasters[e]);
+        changed |= LAYER_BIT(e);
+    }
+
+    derive_missing_shadows(g_svg_handles, layer_hints);
+
+    if (changed & (LAYER_BIT(CLOCK_DROP_SHADOW) | LAYER_BIT(CLOCK_HOUR_HAND))) {
+        int old_w = theme_width, old_h = theme_height;
+        update_theme_size(theme_canvas_svg(g_svg_handles));
+        if (theme_width != old_w || theme_height != old_h)
+            changed = ~0u;  // new canvas size: every layer is placed differently
+    }
+
+    build_render_passes(changed);
+    for (guint v = 0; v < clock_views->len; v++) {
+        ClockView *view = g_ptr_array_index(clock_views, v);
+        for (size_t i = 0; i < G_N_ELEMENTS(chrono_subdials); i++) {
+            if (changed & LAYER_BIT(chrono_subdials[i].hand))
+                subdial_clear(&view->subdials[i]);
+        }
+    }
+
+    if (load->full) {
+        g_free(theme);
+        theme = g_strdup(load->theme_name);
+        userthemes = load->user;
+        watch_theme_dir();
+    }
+
+    queue_draw_views(FALSE);
+}
+
+static void on_theme_loaded(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    ThemeLoad *load = g_task_get_task_data(G_TASK(result));
+
+    if (!load->full) {
+        // Started before a switch that has since replaced the theme
+        if (strcmp(load->theme_name, theme) || load->user != userthemes)
+            return;
+        apply_theme_load(load);
+        return;
+    }
+
+    if (load->serial != theme_switch_serial)
+        return;  // superseded by a newer switch
+    theme_switch_pending = FALSE;
+    if (theme_load_complete(load))
+        apply_theme_load(load);
+    if (theme_deferred_mask) {
+        guint32 mask = theme_deferred_mask;
+        theme_deferred_mask = 0;
+        start_theme_load(theme, userthemes, FALSE, mask);
+    }
+}
+
+static void start_theme_load(const char *theme_name, gboolean user, gboolean full, guint32 mask) {
+    if (!full && theme_switch_pending) {
+        theme_deferred_mask |= mask;
+        return;
+    }
+
+    ThemeLoad *load = g_new0(ThemeLoad, 1);
+    load->theme_name = g_strdup(theme_name);
+    load->user = user;
+    load->full = full;
+    if (full) {
+        load->serial = ++theme_switch_serial;
+        theme_switch_pending = TRUE;
+    }
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if ((mask & LAYER_BIT(e)) && layer_wanted(e))
+            load->mask |= LAYER_BIT(e);
+    }
+
+    GTask *task = g_task_new(NULL, NULL, on_theme_loaded, NULL);
+    g_task_set_task_data(task, load, theme_load_free);
+    g_task_run_in_thread(task, theme_load_thread);
+    g_object_unref(task);
+}
+
+static gboolean reload_changed_layers(gpointer user_data) {
+    theme_reload_id = 0;
+    start_theme_load(theme, userthemes, FALSE, theme_changed_mask);
+    theme_changed_mask = 0;
+    return G_SOURCE_REMOVE;
+}
+
+static void on_theme_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type,
+                                 gpointer user_data) {
+    switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+        break;
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        // Editors save by renaming a temporary file over the layer
+        file = other_file;
+        break;
+    default:
+        return;
+    }
+    if (!file)
+        return;
+
+    gchar *name = g_file_get_basename(file);
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if (!g_strcmp0(name, layer_files[e].file))
+            theme_changed_mask |= LAYER_BIT(e);
+    }
+    int raster_layer = theme_raster_layer(name);
+    if (raster_layer >= 0)
+        theme_changed_mask |= LAYER_BIT(raster_layer);
+    // New hints can change which files are loaded at all
+    if (!g_strcmp0(name, THEME_MANIFEST))
+        theme_changed_mask = ~0u;
+    g_free(name);
+
+    // Coalesce the burst of events a save produces into one reload
+    if (theme_changed_mask && !theme_reload_id)
+        theme_reload_id = g_timeout_add(THEME_RELOAD_DELAY_MS, reload_changed_layers, NULL);
+}
+
+static void watch_theme_dir(void) {
+    GError *err = NULL;
+    gchar *dir = theme_dir_path(theme, userthemes);
+    GFile *file = g_file_new_for_path(dir);
+
+    g_clear_object(&theme_monitor);
+    theme_monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES, NULL, &err);
+    if (theme_monitor) {
+        g_signal_connect(theme_monitor, "changed", G_CALLBACK(on_theme_dir_changed), NULL);
+    } else {
+        g_warning("Cannot watch theme directory %s: %s", dir, err->message);
+        g_clear_error(&err);
+    }
+
+    g_object_unref(file);
+    g_free(dir);
+}
+
+static gboolean theme_name_valid(const char *name) {
+    return *name && !strchr(name, G_DIR_SEPARATOR) && strcmp(name, "..");
+}
+
+// app.theme switches to the named theme, app.user-themes between user and system themes
+static void on_theme_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    const gchar *name = g_variant_get_string(parameter, NULL);
+    if (!theme_name_valid(name)) {
+        g_printerr("Invalid theme name %s\n", name);
+        return;
+    }
+    start_theme_load(name, userthemes, TRUE, ~0u);
+}
+
+static void on_user_themes_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    start_theme_load(theme, g_variant_get_boolean(parameter), TRUE, ~0u);
+}
+
+// Runtime control: app.hz, app.seconds and app.size are stateful actions, so
+// like app.theme they can be set and read over D-Bus through org.gtk.Actions.
+// Edits to clok4.conf are applied the same way. Each change loads or frees
+// only what it affects, e.g. the second hand SVGs are loaded when seconds are
+// first shown and freed when they are hidden
+#define CONFIG_RELOAD_DELAY_MS 250
+
+static GFileMonitor *config_monitor = NULL;
+static guint config_reload_id;
+
+static void set_action_state(const char *name, GVariant *state) {
+    GApplication *app = g_application_get_default();
+    GAction *action = app ? g_action_map_lookup_action(G_ACTION_MAP(app), name) : NULL;
+    if (action)
+        g_simple_action_set_state(G_SIMPLE_ACTION(action), state);
+    else
+        g_variant_unref(g_variant_ref_sink(state));
+}
+
+static void set_refresh_rate(int hz) {
+    if (hz < 1 || hz > 240) {
+        g_printerr("Invalid refresh rate %d\n", hz);
+        return;
+    }
+    refresh_rate = hz;
+    for (guint v = 0; v < clock_views->len; v++) {
+        ClockView *view = g_ptr_array_index(clock_views, v);
+        frame_pacer_reset(&view->scheduler.clock_pacer);
+    }
+    set_action_state("hz", g_variant_new_int32(hz));
+}
+
+static void set_show_seconds(gboolean show) {
+    if (show == !dont_show_seconds)
+        return;
+    dont_show_seconds = !show;
+
+    if (show && !g_svg_handles[CLOCK_SECOND_HAND]) {
+        start_theme_load(theme, userthemes, FALSE, LAYER_BIT(CLOCK_SECOND_HAND) | LAYER_BIT(CLOCK_SECOND_HAND_SHADOW));
+    } else {
+        if (!show) {
+            g_clear_object(&g_svg_handles[CLOCK_SECOND_HAND]);
+            g_clear_object(&g_svg_handles[CLOCK_SECOND_HAND_SHADOW]);
+        }
+        build_render_passes(0);
+        queue_draw_views(FALSE);
+    }
+    set_action_state("seconds", g_variant_new_boolean(show));
+}
+
+static void set_clock_size(int width, int height) {
+    if (width < 100 || width > 8192 || height < 100 || height > 8192) {
+        g_printerr("Invalid size %dx%d\n", width, height);
+        return;
+    }
+    clock_width = width;
+    clock_height = height;
+    if (g_window)
+        gtk_window_set_default_size(GTK_WINDOW(g_window), width, height);
+    set_action_state("size", g_variant_new("(ii)", width, height));
+}
+
+static void on_hz_change(GSimpleAction *action, GVariant *value, gpointer user_data) {
+    set_refresh_rate(g_variant_get_int32(value));
+}
+
+static void on_seconds_change(GSimpleAction *action, GVariant *value, gpointer user_data) {
+    set_show_seconds(g_variant_get_boolean(value));
+}
+
+static void on_size_change(GSimpleAction *action, GVariant *value, gpointer user_data) {
+    int width, height;
+    g_variant_get(value, "(ii)", &width, &height);
+    set_clock_size(width, height);
+}
+
+// Apply the settings of a changed clok4.conf that can change at runtime
+static gboolean reload_config(gpointer user_data) {
+    GError *err = NULL;
+    GKeyFile *kf = g_key_file_new();
+    config_reload_id = 0;
+
+    if (!g_key_file_load_from_file(kf, config_file, G_KEY_FILE_NONE, &err)) {
+        if (!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_printerr("Failed to reload configuration: %s\n", err->message);
+        g_clear_error(&err);
+        g_key_file_free(kf);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (g_key_file_has_key(kf, "Settings", "hz", NULL)) {
+        int hz = g_key_file_get_integer(kf, "Settings", "hz", NULL);
+        if (hz != refresh_rate)
+            set_refresh_rate(hz);
+    }
+    if (g_key_file_has_key(kf, "Settings", "noseconds", NULL))
+        set_show_seconds(!g_key_file_get_boolean(kf, "Settings", "noseconds", NULL));
+    if (g_key_file_has_key(kf, "Settings", "width", NULL) && g_key_file_has_key(kf, "Settings", "height", NULL)) {
+        int width = g_key_file_get_integer(kf, "Settings", "width", NULL);
+        int height = g_key_file_get_integer(kf, "Settings", "height", NULL);
+        if (width != clock_width || height != clock_height)
+            set_clock_size(width, height);
+    }
+
+    gchar *name = g_key_file_get_string(kf, "Settings", "theme", NULL);
+    gboolean user = g_key_file_has_key(kf, "Settings", "userthemes", NULL)
+                        ? g_key_file_get_boolean(kf, "Settings", "userthemes", NULL)
+                        : userthemes;
+    if (name && (strcmp(name, theme) || user != userthemes)) {
+        if (theme_name_valid(name))
+            start_theme_load(name, user, TRUE, ~0u);
+        else
+            g_printerr("Invalid theme name %s\n", name);
+    }
+    g_free(name);
+
+    // Keep the reloaded file for saving at exit
+    g_key_file_free(key_file);
+    key_file = kf;
+    return G_SOURCE_REMOVE;
+}
+
+static void on_config_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type,
+                              gpointer user_data) {
+    switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+        // Coalesce the events of one save, or of a push replacing the file
+        if (!config_reload_id)
+            config_reload_id = g_timeout_add(CONFIG_RELOAD_DELAY_MS, reload_config, NULL);
+        break;
+    default:
+        break;
+    }
+}
+
+static void watch_config_file(void) {
+    GError *err = NULL;
+    GFile *file = g_file_new_for_path(config_file);
+    config_monitor = g_file_monitor_file(file, G_FILE_MONITOR_WATCH_MOVES, NULL, &err);
+    if (config_monitor) {
+        g_signal_connect(config_monitor, "changed", G_CALLBACK(on_config_changed), NULL);
+    } else {
+        g_warning("Cannot watch %s: %s", config_file, err->message);
+        g_clear_error(&err);
+    }
+    g_object_unref(file);
+}
+
+// Theme browser: --list-themes prints the themes of both theme directories and
+// app.pick-theme opens a picker. Previews are rendered by a pool of worker
+// threads, newest request first, and cancelled when their row scrolls out of
+// view. Rendered previews are kept as PNG in $XDG_CACHE_HOME/clok4/thumbnails
+// under the SHA-256 of the theme's files, so a theme is only rendered again
+// after it changes
+#define THUMBNAIL_SIZE    256  // pixels
+#define THUMBNAIL_DISPLAY 128  // logical size in the picker
+#define THUMBNAIL_VERSION "3"  // bump when the preview rendering changes
+
+typedef struct {
+    gchar *name;
+    gboolean user;
+} ThemeEntry;
+
+static void theme_entry_free(gpointer data) {
+    ThemeEntry *entry = data;
+    g_free(entry->name);
+    g_free(entry);
+}
+
+static gint theme_entry_compare(gconstpointer a, gconstpointer b) {
+    const ThemeEntry *x = *(const ThemeEntry *const *)a, *y = *(const ThemeEntry *const *)b;
+    int c = g_utf8_collate(x->name, y->name);
+    return c ? c : x->user - y->user;
+}
+
+// Whether dir has every layer a theme needs
+static gboolean theme_dir_complete(const char *dir) {
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if (!layer_files[e].needed)
+            continue;
+        gchar *path = g_build_filename(dir, layer_files[e].file, NULL);
+        gboolean found = g_file_test(path, G_FILE_TEST_IS_REGULAR);
+        g_free(path);
+        if (!found) {
+            // A static layer may come as raster assets only
+            GPtrArray *rasters = theme_find_rasters(dir, layer_files[e].file);
+            if (!rasters)
+                return FALSE;
+            g_ptr_array_unref(rasters);
+        }
+    }
+    return TRUE;
+}
+
+// Themes in the system and user theme directories, sorted by name
+static GPtrArray *scan_themes(void) {
+    GPtrArray *themes = g_ptr_array_new_with_free_func(theme_entry_free);
+
+    for (int user = 0; user <= 1; user++) {
+        gchar *base = g_build_filename(user ? config_dir : themesystem, "themes", NULL);
+        GDir *d = g_dir_open(base, 0, NULL);
+        const gchar *name;
+        while (d && (name = g_dir_read_name(d))) {
+            gchar *dir = theme_dir_path(name, user);
+            if (theme_dir_complete(dir)) {
+                ThemeEntry *entry = g_new0(ThemeEntry, 1);
+                entry->name = g_strdup(name);
+                entry->user = user;
+                g_ptr_array_add(themes, entry);
+            }
+            g_free(dir);
+        }
+        if (d)
+            g_dir_close(d);
+        g_free(base);
+    }
+
+    g_ptr_array_sort(themes, theme_entry_compare);
+    return themes;
+}
+
+static void print_theme_list(void) {
+    GPtrArray *themes = scan_themes();
+    for (guint i = 0; i < themes->len; i++) {
+        const ThemeEntry *entry = g_ptr_array_index(themes, i);
+        gboolean current = !strcmp(entry->name, theme) && entry->user == userthemes;
+        gchar *dir = theme_dir_path(entry->name, entry->user);
+        g_print("%c %-24s %-6s %s\n", current ? '*' : ' ', entry->name, entry->user ? "user" : "system", dir);
+        g_free(dir);
+    }
+    if (!themes->len)
+        g_printerr("No themes found in %s/themes or %s/themes\n", themesystem, config_dir);
+    g_ptr_array_unref(themes);
+}
+
+static gint compare_file_names(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Content hashes by theme directory, with the names, sizes and modification
+// times of the files they were computed from; shared by the thumbnail threads
+typedef struct {
+    gchar *stamp;
+    gchar *hash;
+} ThemeHash;
+
+static GMutex theme_hashes_lock;
+static GHashTable *theme_hashes;
+
+static void theme_hash_free(gpointer data) {
+    ThemeHash *entry = data;
+    g_free(entry->stamp);
+    g_free(entry->hash);
+    g_free(entry);
+}
+
+// SHA-256 over the names and contents of the theme's files, or NULL if the
+// directory cannot be read. The files are only read again when one of them
+// changed in name, size or modification time since the last call for dir
+static gchar *theme_content_hash(const char *dir) {
+    GDir *d = g_dir_open(dir, 0, NULL);
+    if (!d)
+        return NULL;
+
+    GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+    const gchar *name;
+    while ((name = g_dir_read_name(d))) {
+        g_ptr_array_add(names, g_strdup(name));
+    }
+    g_dir_close(d);
+    g_ptr_array_sort(names, compare_file_names);
+
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GString *stamp = g_string_new(NULL);
+    for (guint i = 0; i < names->len; i++) {
+        const char *file = g_ptr_array_index(names, i);
+        gchar *path = g_build_filename(dir, file, NULL);
+        GStatBuf st;
+        if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            g_free(path);
+            continue;
+        }
+        g_string_append_printf(stamp, "%s/%" G_GINT64_FORMAT "/%" G_GINT64_FORMAT ".%09ld\n", file,
+                               (gint64)st.st_size, (gint64)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+        g_ptr_array_add(paths, path);
+    }
+
+    gchar *hash = NULL;
+    g_mutex_lock(&theme_hashes_lock);
+    if (!theme_hashes)
+        theme_hashes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, theme_hash_free);
+    ThemeHash *cached = g_hash_table_lookup(theme_hashes, dir);
+    if (cached && !strcmp(cached->stamp, stamp->str))
+        hash = g_strdup(cached->hash);
+    g_mutex_unlock(&theme_hashes_lock);
+
+    if (!hash) {
+        GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+        g_checksum_update(checksum, (const guchar *)THUMBNAIL_VERSION, -1);
+        for (guint i = 0; i < paths->len; i++) {
+            const char *path = g_ptr_array_index(paths, i);
+            gchar *file = g_path_get_basename(path);
+            gchar *contents;
+            gsize length;
+            if (g_file_get_contents(path, &contents, &length, NULL)) {
+                g_checksum_update(checksum, (const guchar *)file, strlen(file) + 1);
+                g_checksum_update(checksum, (const guchar *)contents, length);
+                g_free(contents);
+            }
+            g_free(file);
+        }
+        hash = g_strdup(g_checksum_get_string(checksum));
+        g_checksum_free(checksum);
+
+        ThemeHash *entry = g_new0(ThemeHash, 1);
+        entry->stamp = g_strdup(stamp->str);
+        entry->hash = g_strdup(hash);
+        g_mutex_lock(&theme_hashes_lock);
+        g_hash_table_replace(theme_hashes, g_strdup(dir), entry);
+        g_mutex_unlock(&theme_hashes_lock);
+    }
+
+    g_string_free(stamp, TRUE);
+    g_ptr_array_unref(paths);
+    g_ptr_array_unref(names);
+    return hash;
+}
+
+// Render a preview of the theme in dir with the hands at 10:08:37; uses its
+// own handles and hints so it can run on any thread
+static cairo_surface_t *render_theme_preview(const char *dir, GCancellable *cancellable) {
+    RsvgHandle *handles[CLOCK_ELEMENTS] = {NULL};
+    GPtrArray *rasters[CLOCK_ELEMENTS] = {NULL};
+    LayerHints hints[CLOCK_ELEMENTS];
+    cairo_surface_t *surface = NULL;
+
+    parse_theme_manifest(dir, hints);
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if (hints[e].shadow_of >= 0)
+            continue;
+        if (hints_transform(e, &hints[e]) == TRANSFORM_STATIC)
+            rasters[e] = theme_find_rasters(dir, layer_files[e].file);
+        if (!rasters[e])
+            handles[e] = theme_load_svg(dir, layer_files[e].file, NULL);
+        if (!handles[e] && !rasters[e] && layer_files[e].needed)
+            goto out;
+    }
+    // Like the clock, so shadowless themes preview with their derived shadows
+    derive_missing_shadows(handles, hints);
+
+    double w = 100.0, h = 100.0;
+    RsvgHandle *canvas = theme_canvas_svg(handles);
+    if (!canvas || !rsvg_handle_get_intrinsic_size_in_pixels(canvas, &w, &h) || w < 1.0 || h < 1.0)
+        w = h = 100.0;
+    RsvgRectangle viewport = {0.0, 0.0, ceil(w), ceil(h)};
+    HandAngles angles = {
+        .hour = 2.0 * M_PI * (10.0 + 8.0 / 60.0) / 12.0,
+        .minute = 2.0 * M_PI * (8.0 + 37.0 / 60.0) / 60.0,
+        .second = 2.0 * M_PI * 37.0 / 60.0,
+    };
+
+    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    cairo_t *cr = cairo_create(surface);
+    cairo_scale(cr, THUMBNAIL_SIZE / viewport.width, THUMBNAIL_SIZE / viewport.height);
+
+    for (size_t i = 0; i < G_N_ELEMENTS(layer_order); i++) {
+        int e = layer_order[i];
+        if (g_cancellable_is_cancelled(cancellable))
+            break;
+        if (e == LAYER_OVERLAYS)
+            continue;
+
+        LayerTransform transform = hints_transform(e, &hints[e]);
+        if (transform == TRANSFORM_STATIC) {
+            cairo_surface_t *raster =
+                rasters[e] ? load_raster(theme_pick_raster(rasters[e], THUMBNAIL_SIZE)->path, NULL) : NULL;
+            if (raster) {
+                paint_raster(cr, raster, &viewport, QUALITY_BEST);
+                cairo_surface_destroy(raster);
+            } else if (handles[e]) {
+                rsvg_handle_render_document(handles[e], cr, &viewport, NULL);
+            }
+            continue;
+        }
+
+        LayerElement source = hints[e].shadow_of >= 0 ? (LayerElement)hints[e].shadow_of : e;
+        if (!handles[source])
+            continue;
+        cairo_save(cr);
+        cairo_translate(cr, viewport.width / 2.0, viewport.height / 2.0);
+        if (layer_is_shadow(e))
+            cairo_translate(cr, SHADOW_OFFSET_Y, -SHADOW_OFFSET_X);
+        cairo_rotate(cr, -M_PI / 2.0);
+        draw_hand_sprite(cr, handles[source], &hints[source], source != e ? &hints[e].shadow_color : NULL,
+                         transform_angle(&angles, transform), &viewport);
+        cairo_restore(cr);
+    }
+    cairo_destroy(cr);
 
-static RsvgHandle *g_svg_handles[CLOCK_ELEMENTS];
-static int clock_width = 400, clock_height = 400;  // window size (config file / command line)
-static int theme_width = 100, theme_height = 100;  // theme canvas size (SVG intrinsic size)
-static int resized_width, resized_height;
-static gboolean size_saved;
-static gchar *theme;
-static int refresh_rate = 5;
-static gboolean userthemes;
-static gboolean dont_show_seconds;
-static GtkWidget *g_window = NULL;
-static GtkWidget *g_clock_widget = NULL;
-static GTimer *g_clock_timer = NULL;
-static GKeyFile *key_file;
-static gchar *config_file;
-static gchar *config_dir;
-static char *themesystem = "/usr/share/clok4";
+    if (g_cancellable_is_cancelled(cancellable))
+        g_clear_pointer(&surface, cairo_surface_destroy);
+
+out:
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        g_clear_object(&handles[e]);
+        g_clear_pointer(&rasters[e], g_ptr_array_unref);
+    }
+    return surface;
+}
 
-// Cached background/foreground textures; face shadow, glass and frame are
-// drawn above the hands, like in the original cairo-clock
-static GdkTexture *bg_cache_texture = NULL;
-static GdkTexture *fg_cache_texture = NULL;
-static int cache_w = 0, cache_h = 0, cache_scale = 0;
+// Picker list item; the picture is the one the item is currently bound to
+#define THEME_TYPE_ITEM (theme_item_get_type())
+G_DECLARE_FINAL_TYPE(ThemeItem, theme_item, THEME, ITEM, GObject)
 
-// Forward declarations
-#define CLOCK_TYPE_WIDGET (clock_widget_get_type())
-G_DECLARE_FINAL_TYPE(ClockWidget, clock_widget, CLOCK, WIDGET, GtkWidget)
+typedef struct ThumbnailJob ThumbnailJob;
 
-struct _ClockWidget {
-    GtkWidget parent_instance;
+struct _ThemeItem {
+    GObject parent_instance;
+    gchar *name;
+    gboolean user;
+    GdkTexture *thumbnail;
+    GtkPicture *picture;
+    ThumbnailJob *job;
 };
 
-G_DEFINE_TYPE(ClockWidget, clock_widget, GTK_TYPE_WIDGET)
+G_DEFINE_TYPE(ThemeItem, theme_item, G_TYPE_OBJECT)
 
-static RsvgHandle *load_svg(const char *filename, gboolean needed) {
-    GError *err = NULL;
-    char *full = g_strconcat(userthemes ? config_dir : themesystem, G_DIR_SEPARATOR_S, "themes", G_DIR_SEPARATOR_S,
-                             theme, G_DIR_SEPARATOR_S, filename, NULL);
-    RsvgHandle *h = rsvg_handle_new_from_file(full, &err);
-    if (!h) {
-        gchar errstring[4096];
-        g_snprintf(errstring, sizeof(errstring), "[%s] Cannot load SVG from %s: %s", needed ? "ERROR" : "WARNING", full,
-                   err ? err->message : "unknown error");
-        g_warning("%s", errstring);
-        g_clear_error(&err);
-        if (needed)
-            exit(EXIT_FAILURE);
+static void theme_item_finalize(GObject *object) {
+    ThemeItem *self = THEME_ITEM(object);
+    g_free(self->name);
+    g_clear_object(&self->thumbnail);
+    G_OBJECT_CLASS(theme_item_parent_class)->finalize(object);
+}
+
+static void theme_item_class_init(ThemeItemClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = theme_item_finalize;
+}
+
+static void theme_item_init(ThemeItem *self) {
+}
+
+struct ThumbnailJob {
+    ThemeItem *item;
+    gchar *name;
+    gboolean user;
+    guint serial;
+    GCancellable *cancellable;
+    GdkTexture *texture;  // result
+};
+
+static GThreadPool *thumbnail_pool = NULL;
+static gchar *thumbnail_dir = NULL;
+static guint thumbnail_serial;
+static GtkWidget *theme_picker = NULL;
+
+static void thumbnail_job_free(gpointer data) {
+    ThumbnailJob *job = data;
+    g_object_unref(job->item);
+    g_free(job->name);
+    g_object_unref(job->cancellable);
+    g_clear_object(&job->texture);
+    g_free(job);
+}
+
+// Most recently requested first: those are the rows the user scrolled to
+static gint thumbnail_job_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const ThumbnailJob *x = a, *y = b;
+    return x->serial < y->serial ? 1 : x->serial > y->serial ? -1 : 0;
+}
+
+static gboolean thumbnail_done(gpointer data) {
+    ThumbnailJob *job = data;
+    ThemeItem *item = job->item;
+
+    if (item->job == job) {
+        item->job = NULL;
+        if (job->texture) {
+            g_set_object(&item->thumbnail, job->texture);
+            if (item->picture)
+                gtk_picture_set_paintable(item->picture, GDK_PAINTABLE(item->thumbnail));
+        }
     }
-    g_free(full);
-    return h;
+    thumbnail_job_free(job);
+    return G_SOURCE_REMOVE;
 }
 
-// Load SVGs once; called from activate so a broken theme fails before the window is shown
-static void load_all_svgs(void) {
-    static gboolean svgs_loaded = FALSE;
-    if (svgs_loaded)
-        return;
+static void thumbnail_thread(gpointer data, gpointer user_data) {
+    ThumbnailJob *job = data;
+    gchar *dir = NULL, *hash = NULL, *path = NULL;
 
-    g_svg_handles[CLOCK_DROP_SHADOW] = load_svg("clock-drop-shadow.svg", TRUE);
-    g_svg_handles[CLOCK_FACE] = load_svg("clock-face.svg", TRUE);
-    g_svg_handles[CLOCK_FACE_SHADOW] = load_svg("clock-face-shadow.svg", FALSE);
-    g_svg_handles[CLOCK_MARKS] = load_svg("clock-marks.svg", FALSE);
-    g_svg_handles[CLOCK_MINUTE_HAND] = load_svg("clock-minute-hand.svg", TRUE);
-    g_svg_handles[CLOCK_MINUTE_HAND_SHADOW] = load_svg("clock-minute-hand-shadow.svg", FALSE);
-    g_svg_handles[CLOCK_HOUR_HAND] = load_svg("clock-hour-hand.svg", TRUE);
-    g_svg_handles[CLOCK_HOUR_HAND_SHADOW] = load_svg("clock-hour-hand-shadow.svg", FALSE);
-    g_svg_handles[CLOCK_GLASS] = load_svg("clock-glass.svg", FALSE);
-    g_svg_handles[CLOCK_FRAME] = load_svg("clock-frame.svg", FALSE);
-
-    if (!dont_show_seconds) {
-        g_svg_handles[CLOCK_SECOND_HAND] = load_svg("clock-second-hand.svg", FALSE);
-        g_svg_handles[CLOCK_SECOND_HAND_SHADOW] = load_svg("clock-second-hand-shadow.svg", FALSE);
-    }
-
-    // Get intrinsic size from drop shadow; keep the 100x100 cairo-clock default
-    // if the SVG has no usable intrinsic size
-    if (g_svg_handles[CLOCK_DROP_SHADOW]) {
-        gdouble w = 0.0, h = 0.0;
-        if (rsvg_handle_get_intrinsic_size_in_pixels(g_svg_handles[CLOCK_DROP_SHADOW], &w, &h) && w >= 1.0 &&
-            h >= 1.0) {
-            theme_width = (int)ceil(w);
-            theme_height = (int)ceil(h);
-        } else {
-            g_warning("Theme drop shadow has no usable intrinsic size, assuming %dx%d", theme_width, theme_height);
+    if (g_cancellable_is_cancelled(job->cancellable))
+        goto out;
+
+    dir = theme_dir_path(job->name, job->user);
+    hash = theme_content_hash(dir);
+    if (!hash)
+        goto out;
+
+    gchar *file = g_strconcat(hash, ".png", NULL);
+    path = g_build_filename(thumbnail_dir, file, NULL);
+    g_free(file);
+
+    cairo_surface_t *surface = cairo_image_surface_create_from_png(path);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        surface = render_theme_preview(dir, job->cancellable);
+        if (surface) {
+            // Write under a temporary name so other instances never read a partial file
+            gchar *tmp = g_strdup_printf("%s.%u.tmp", path, (unsigned)getpid());
+            if (cairo_surface_write_to_png(surface, tmp) != CAIRO_STATUS_SUCCESS || g_rename(tmp, path) != 0)
+                g_unlink(tmp);
+            g_free(tmp);
         }
     }
+    if (surface)
+        job->texture = texture_from_surface(surface);
 
-    svgs_loaded = TRUE;
+out:
+    g_free(path);
+    g_free(hash);
+    g_free(dir);
+    g_idle_add(thumbnail_done, job);
 }
 
-// Frame-synced redraw driven by the widget's frame clock, throttled to refresh_rate
-static gboolean tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data) {
-    static gint64 last_redraw;
-    gint64 now = gdk_frame_clock_get_frame_time(frame_clock);
-    if (now - last_redraw >= G_USEC_PER_SEC / refresh_rate) {
-        last_redraw = now;
-        gtk_widget_queue_draw(widget);
+static void request_thumbnail(ThemeItem *item) {
+    if (!thumbnail_pool) {
+        thumbnail_dir = g_build_filename(g_get_user_cache_dir(), APP_NAME, "thumbnails", NULL);
+        if (g_mkdir_with_parents(thumbnail_dir, 0700) == -1)
+            g_printerr("Failed to create directory: %s\n", thumbnail_dir);
+        thumbnail_pool = g_thread_pool_new_full(thumbnail_thread, NULL, thumbnail_job_free,
+                                                (gint)g_get_num_processors(), FALSE, NULL);
+        g_thread_pool_set_sort_function(thumbnail_pool, thumbnail_job_compare, NULL);
     }
-    return G_SOURCE_CONTINUE;
+
+    ThumbnailJob *job = g_new0(ThumbnailJob, 1);
+    job->item = g_object_ref(item);
+    job->name = g_strdup(item->name);
+    job->user = item->user;
+    job->serial = ++thumbnail_serial;
+    job->cancellable = g_cancellable_new();
+    item->job = job;
+    g_thread_pool_push(thumbnail_pool, job, NULL);
 }
 
-static void load_transparent_css(void) {
-    GtkCssProvider *provider = gtk_css_provider_new();
-    const gchar *css = "window, box, widget { background-color: transparent; }";
-    gtk_css_provider_load_from_string(provider, css);
-    gtk_style_context_add_provider_for_display(gdk_display_get_default(), GTK_STYLE_PROVIDER(provider),
-                                               GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-    g_object_unref(provider);
+static void on_picker_item_setup(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+    GtkWidget *picture = gtk_picture_new();
+    gtk_widget_set_size_request(picture, THUMBNAIL_DISPLAY, THUMBNAIL_DISPLAY);
+    gtk_box_append(GTK_BOX(box), picture);
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+    gtk_box_append(GTK_BOX(box), label);
+    gtk_list_item_set_child(list_item, box);
 }
 
-// Render a group of static theme layers into a texture at device-pixel resolution
-static GdkTexture *render_layers_texture(const LayerElement *layers, size_t n_layers, int device_w, int device_h) {
-    // Create a Cairo surface to render the layers
-    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, device_w, device_h);
-    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
-        cairo_surface_destroy(surface);
-        return NULL;
+static void on_picker_item_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    ThemeItem *item = gtk_list_item_get_item(list_item);
+    GtkWidget *box = gtk_list_item_get_child(list_item);
+    GtkWidget *picture = gtk_widget_get_first_child(box);
+    GtkWidget *label = gtk_widget_get_last_child(box);
+
+    gtk_label_set_text(GTK_LABEL(label), item->name);
+    gtk_widget_set_tooltip_text(box, item->user ? "User theme" : "System theme");
+    gtk_picture_set_paintable(GTK_PICTURE(picture), item->thumbnail ? GDK_PAINTABLE(item->thumbnail) : NULL);
+    item->picture = GTK_PICTURE(picture);
+    if (!item->thumbnail && !item->job)
+        request_thumbnail(item);
+}
+
+// A row scrolled out of view no longer needs its preview
+static void on_picker_item_unbind(GtkSignalListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    ThemeItem *item = gtk_list_item_get_item(list_item);
+    item->picture = NULL;
+    if (item->job) {
+        g_cancellable_cancel(item->job->cancellable);
+        item->job = NULL;
     }
-    cairo_t *cr = cairo_create(surface);
+}
 
-    // Clear to transparent
-    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
-    cairo_paint(cr);
-    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+static void on_picker_activate(GtkGridView *view, guint position, gpointer user_data) {
+    GListModel *model = G_LIST_MODEL(gtk_grid_view_get_model(view));
+    ThemeItem *item = g_list_model_get_item(model, position);
+    start_theme_load(item->name, item->user, TRUE, ~0u);
+    g_object_unref(item);
+    gtk_window_destroy(GTK_WINDOW(theme_picker));
+}
 
-    // Scale and render the static layers
-    cairo_scale(cr, (double)device_w / theme_width, (double)device_h / theme_height);
+static void on_picker_destroy(GtkWidget *widget, gpointer user_data) {
+    theme_picker = NULL;
+}
 
-    RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+static void on_pick_theme_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    if (theme_picker) {
+        gtk_window_present(GTK_WINDOW(theme_picker));
+        return;
+    }
 
-    for (size_t i = 0; i < n_layers; i++) {
-        if (g_svg_handles[layers[i]]) {
-            rsvg_handle_render_document(g_svg_handles[layers[i]], cr, &viewport, NULL);
-        }
+    GListStore *store = g_list_store_new(THEME_TYPE_ITEM);
+    GPtrArray *themes = scan_themes();
+    for (guint i = 0; i < themes->len; i++) {
+        const ThemeEntry *entry = g_ptr_array_index(themes, i);
+        ThemeItem *item = g_object_new(THEME_TYPE_ITEM, NULL);
+        item->name = g_strdup(entry->name);
+        item->user = entry->user;
+        g_list_store_append(store, item);
+        g_object_unref(item);
     }
+    g_ptr_array_unref(themes);
 
-    cairo_destroy(cr);
-    // Finish pending drawing before accessing the pixel data directly
-    cairo_surface_flush(surface);
+    GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(on_picker_item_setup), NULL);
+    g_signal_connect(factory, "bind", G_CALLBACK(on_picker_item_bind), NULL);
+    g_signal_connect(factory, "unbind", G_CALLBACK(on_picker_item_unbind), NULL);
 
-    // Convert Cairo surface to GdkTexture
-    GBytes *bytes =
-        g_bytes_new_with_free_func(cairo_image_surface_get_data(surface),
-                                   cairo_image_surface_get_height(surface) * cairo_image_surface_get_stride(surface),
-                                   (GDestroyNotify)cairo_surface_destroy, surface);
+    GtkWidget *view = gtk_grid_view_new(GTK_SELECTION_MODEL(gtk_single_selection_new(G_LIST_MODEL(store))), factory);
+    gtk_grid_view_set_single_click_activate(GTK_GRID_VIEW(view), TRUE);
+    g_signal_connect(view, "activate", G_CALLBACK(on_picker_activate), NULL);
 
-    GdkTexture *texture =
-        gdk_memory_texture_new(device_w, device_h, GDK_MEMORY_DEFAULT, bytes, cairo_image_surface_get_stride(surface));
+    GtkWidget *scrolled = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), view);
 
-    g_bytes_unref(bytes);
-    return texture;
+    theme_picker = gtk_window_new();
+    gtk_window_set_application(GTK_WINDOW(theme_picker), GTK_APPLICATION(user_data));
+    gtk_window_set_title(GTK_WINDOW(theme_picker), APP_NAME " themes");
+    gtk_window_set_default_size(GTK_WINDOW(theme_picker), 5 * THUMBNAIL_DISPLAY, 4 * THUMBNAIL_DISPLAY);
+    if (g_window)
+        gtk_window_set_transient_for(GTK_WINDOW(theme_picker), GTK_WINDOW(g_window));
+    gtk_window_set_child(GTK_WINDOW(theme_picker), scrolled);
+    g_signal_connect(theme_picker, "destroy", G_CALLBACK(on_picker_destroy), NULL);
+    gtk_window_present(GTK_WINDOW(theme_picker));
 }
 
-// Create cached background/foreground textures (called once per size or scale-factor change)
-static void ensure_layer_caches(GtkWidget *widget, int width, int height) {
-    int scale = gtk_widget_get_scale_factor(widget);
+// Metrics: the counters in metrics and node_stats, served in the Prometheus
+// text format to anyone connecting to the --metrics-socket UNIX socket (e.g.
+// socat - UNIX-CONNECT:PATH) and as read-only properties of the
+// clok4.CairoClock.Metrics interface on the application's D-Bus object
+static GSocketService *metrics_service = NULL;
+static guint metrics_dbus_id;
 
-    if (bg_cache_texture && fg_cache_texture && width == cache_w && height == cache_h && scale == cache_scale) {
-        return;  // Already cached at this size
+static guint64 texture_bytes(void) {
+    guint64 bytes = 0;
+    // Cached textures shared between views count once
+    GHashTable *seen = g_hash_table_new(NULL, NULL);
+    for (guint v = 0; v < clock_views->len; v++) {
+        const ClockView *view = g_ptr_array_index(clock_views, v);
+        for (size_t i = 0; i < view->n_passes; i++) {
+            const RenderPass *pass = &view->passes[i];
+            if (pass->texture && g_hash_table_add(seen, pass->texture))
+                bytes += (guint64)gdk_texture_get_width(pass->texture) * gdk_texture_get_height(pass->texture) * 4;
+            for (size_t k = 0; k < pass->n_layers; k++) {
+                GdkTexture *texture = pass->blur_sprites[k].texture;
+                if (texture)
+                    bytes += (guint64)gdk_texture_get_width(texture) * gdk_texture_get_height(texture) * 4;
+            }
+        }
     }
+    g_hash_table_unref(seen);
+    // Raster assets decoded for passes not rendered yet
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        cairo_surface_t *surface = layer_rasters[e].surface;
+        if (surface)
+            bytes += (guint64)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+    }
+    for (guint v = 0; v < clock_views->len; v++) {
+        const ClockView *view = g_ptr_array_index(clock_views, v);
+        for (size_t i = 0; i < G_N_ELEMENTS(view->complications); i++) {
+            GdkTexture *texture = view->complications[i].texture;
+            if (texture)
+                bytes += (guint64)gdk_texture_get_width(texture) * gdk_texture_get_height(texture) * 4;
+        }
+        for (size_t i = 0; i < G_N_ELEMENTS(view->subdials); i++) {
+            GdkTexture *textures[] = {view->subdials[i].ring, view->subdials[i].hand};
+            for (size_t k = 0; k < G_N_ELEMENTS(textures); k++) {
+                if (textures[k])
+                    bytes += (guint64)gdk_texture_get_width(textures[k]) * gdk_texture_get_height(textures[k]) * 4;
+            }
+        }
+    }
+    return bytes;
+}
 
-    g_clear_object(&bg_cache_texture);
-    g_clear_object(&fg_cache_texture);
-
-    // Render at device pixels so the textures stay sharp on HiDPI displays
-    int device_w = width * scale;
-    int device_h = height * scale;
+static guint64 resident_bytes(void) {
+    gchar *statm;
+    guint64 pages = 0;
+    if (g_file_get_contents("/proc/self/statm", &statm, NULL, NULL)) {
+        const char *resident = strchr(statm, ' ');
+        if (resident)
+            pages = g_ascii_strtoull(resident + 1, NULL, 10);
+        g_free(statm);
+    }
+    return pages * (guint64)sysconf(_SC_PAGESIZE);
+}
 
-    // Static layers below the hands
-    static const LayerElement bg_layers[] = {CLOCK_DROP_SHADOW, CLOCK_FACE, CLOCK_MARKS};
-    // Static layers above the hands
-    static const LayerElement fg_layers[] = {CLOCK_FACE_SHADOW, CLOCK_GLASS, CLOCK_FRAME};
+// Frames per second over the last full second; once the clock has idled for
+// longer, the rate of the still-open window
+static double effective_hz(void) {
+    gint64 elapsed = g_get_monotonic_time() - metrics.hz_window_start;
+    if (elapsed > 2 * G_USEC_PER_SEC)
+        return metrics.hz_window_frames * (double)G_USEC_PER_SEC / elapsed;
+    return metrics.effective_hz;
+}
 
-    bg_cache_texture = render_layers_texture(bg_layers, G_N_ELEMENTS(bg_layers), device_w, device_h);
-    fg_cache_texture = render_layers_texture(fg_layers, G_N_ELEMENTS(fg_layers), device_w, device_h);
+static void metric_header(GString *out, const char *name, const char *type, const char *help) {
+    g_string_append_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
 
-    cache_w = width;
-    cache_h = height;
-    cache_scale = scale;
+static void metric_counter(GString *out, const char *name, const char *help, guint64 value) {
+    metric_header(out, name, "counter", help);
+    g_string_append_printf(out, "%s %" G_GUINT64_FORMAT "\n", name, value);
 }
 
-// Custom widget snapshot function - optimized version
-static void clock_widget_snapshot(GtkWidget *widget, GtkSnapshot *snapshot) {
-    int width = gtk_widget_get_width(widget);
-    int height = gtk_widget_get_height(widget);
+static void metric_double(GString *out, const char *name, const char *type, const char *help, double value) {
+    metric_header(out, name, type, help);
+    g_string_append_printf(out, "%s %.6g\n", name, value);
+}
 
-    if (width <= 0 || height <= 0)
-        return;
+static void metric_gauge(GString *out, const char *name, const char *help, double value) {
+    metric_double(out, name, "gauge", help, value);
+}
 
-    // Ensure background/foreground caches are ready
-    ensure_layer_caches(widget, width, height);
+static GString *metrics_text(void) {
+    GString *out = g_string_new(NULL);
 
-    graphene_rect_t bounds = GRAPHENE_RECT_INIT(0, 0, width, height);
+    metric_counter(out, "clok4_frames_drawn_total", "Frames snapshotted", metrics.frames_drawn);
+    metric_counter(out, "clok4_frames_skipped_total", "Frame clock ticks that drew nothing", metrics.frames_skipped);
+    metric_counter(out, "clok4_wakeups_total", "Tick callbacks and timer resumes", metrics.wakeups);
+    metric_counter(out, "clok4_cache_rebuilds_total", "Cached layer textures rasterized", metrics.cache_rebuilds);
+    metric_double(out, "clok4_cache_rebuild_seconds_total", "counter", "Time spent rasterizing cached layer textures",
+                  metrics.cache_rebuild_usec / (double)G_USEC_PER_SEC);
+    metric_gauge(out, "clok4_cache_rebuild_last_seconds", "Duration of the latest cache rebuild",
+                 metrics.last_rebuild_usec / (double)G_USEC_PER_SEC);
 
-    // Draw cached background texture (fast!)
-    if (bg_cache_texture) {
-        gtk_snapshot_append_texture(snapshot, bg_cache_texture, &bounds);
+    static const char *const kinds[] = {"hits", "misses", "evictions"};
+    static const char *const helps[] = {"Cached textures reused", "Cached textures rasterized",
+                                        "Cached textures dropped"};
+    for (size_t k = 0; k < G_N_ELEMENTS(kinds); k++) {
+        gchar *name = g_strdup_printf("clok4_cache_%s_total", kinds[k]);
+        metric_header(out, name, "counter", helps[k]);
+        if (metrics.cache_sizes) {
+            GHashTableIter iter;
+            gpointer key, value;
+            g_hash_table_iter_init(&iter, metrics.cache_sizes);
+            while (g_hash_table_iter_next(&iter, &key, &value)) {
+                const CacheSizeStats *stats = value;
+                guint64 count = k == 0 ? stats->hits : k == 1 ? stats->misses : stats->evictions;
+                g_string_append_printf(out, "%s{size=\"%s\"} %" G_GUINT64_FORMAT "\n", name, (const char *)key, count);
+            }
+        }
+        g_free(name);
     }
 
-    // Get current time
-    struct timespec ts;
-    struct tm tm;
-    time_t time_sec;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    time_sec = ts.tv_sec;
-    localtime_r(&time_sec, &tm);
+    metric_header(out, "clok4_render_nodes_total", "counter", "Retained render nodes by outcome");
+    g_string_append_printf(out, "clok4_render_nodes_total{outcome=\"built\"} %" G_GUINT64_FORMAT "\n",
+                           node_stats.built);
+    g_string_append_printf(out, "clok4_render_nodes_total{outcome=\"reused\"} %" G_GUINT64_FORMAT "\n",
+                           node_stats.reused);
 
-    int hour = tm.tm_hour;
-    int minute = tm.tm_min;
-    double second = tm.tm_sec + ((double)ts.tv_nsec / 1e9);
+    metric_gauge(out, "clok4_texture_bytes", "Memory held by cached textures", (double)texture_bytes());
+    metric_gauge(out, "clok4_resident_bytes", "Resident set size", (double)resident_bytes());
+    metric_gauge(out, "clok4_effective_hz", "Frames drawn per second", effective_hz());
+    metric_gauge(out, "clok4_target_hz", "Configured hand refresh rate", refresh_rate);
 
-    // Calculate angles in radians
-    double angle_hour = (hour % 12) * 30.0 + (minute * 0.5) + (second * (0.5 / 60.0));
-    double angle_minute = minute * 6.0 + (second * 0.1);
-    double angle_second = second * 6.0;
+    metric_header(out, "clok4_strategy", "gauge", "Current redraw strategy");
+    g_string_append_printf(out, "clok4_strategy{strategy=\"%s\"} 1\n", metrics.strategy);
+    return out;
+}
 
-    double angle_hour_rad = angle_hour * (M_PI / 180.0);
-    double angle_min_rad = angle_minute * (M_PI / 180.0);
-    double angle_sec_rad = angle_second * (M_PI / 180.0);
+// A client that stops reading gives up its connection after this many seconds
+#define METRICS_WRITE_TIMEOUT 5
 
-    // Draw hands using Cairo (only 6 small SVGs per frame)
-    cairo_t *cr = gtk_snapshot_append_cairo(snapshot, &bounds);
+// Metrics text on its way to one client
+typedef struct {
+    GSocketConnection *connection;
+    GString *text;
+} MetricsReply;
 
-    cairo_save(cr);
-    double sx = (double)width / theme_width;
-    double sy = (double)height / theme_height;
-    cairo_translate(cr, width / 2.0, height / 2.0);
-    cairo_scale(cr, sx, sy);
-    cairo_rotate(cr, -M_PI / 2.0);
+static void on_metrics_written(GObject *source, GAsyncResult *result, gpointer user_data) {
+    MetricsReply *reply = user_data;
+    GError *err = NULL;
+    if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, &err)) {
+        g_debug("Cannot write metrics: %s", err->message);
+        g_clear_error(&err);
+    }
+    g_io_stream_close_async(G_IO_STREAM(reply->connection), G_PRIORITY_DEFAULT, NULL, NULL, NULL);
+    g_object_unref(reply->connection);
+    g_string_free(reply->text, TRUE);
+    g_free(reply);
+}
 
-    RsvgRectangle viewport = {0.0, 0.0, (double)theme_width, (double)theme_height};
+// The text is written asynchronously, so a slow client never stalls the clock
+static gboolean on_metrics_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object,
+                                    gpointer user_data) {
+    MetricsReply *reply = g_new0(MetricsReply, 1);
+    reply->connection = g_object_ref(connection);
+    reply->text = metrics_text();
+    g_socket_set_timeout(g_socket_connection_get_socket(connection), METRICS_WRITE_TIMEOUT);
+    g_output_stream_write_all_async(g_io_stream_get_output_stream(G_IO_STREAM(connection)), reply->text->str,
+                                    reply->text->len, G_PRIORITY_DEFAULT, NULL, on_metrics_written, reply);
+    return TRUE;
+}
 
-    // Hour hand shadow
-    if (g_svg_handles[CLOCK_HOUR_HAND_SHADOW]) {
-        cairo_save(cr);
-        cairo_translate(cr, SHADOW_OFFSET_X, SHADOW_OFFSET_Y);
-        cairo_rotate(cr, angle_hour_rad);
-        rsvg_handle_render_document(g_svg_handles[CLOCK_HOUR_HAND_SHADOW], cr, &viewport, NULL);
-        cairo_restore(cr);
-    }
+static void start_metrics_socket(void) {
+    GError *err = NULL;
+    if (!metrics_socket || !*metrics_socket)
+        return;
 
-    // Minute hand shadow
-    if (g_svg_handles[CLOCK_MINUTE_HAND_SHADOW]) {
-        cairo_save(cr);
-        cairo_translate(cr, SHADOW_OFFSET_X, SHADOW_OFFSET_Y);
-        cairo_rotate(cr, angle_min_rad);
-        rsvg_handle_render_document(g_svg_handles[CLOCK_MINUTE_HAND_SHADOW], cr, &viewport, NULL);
-        cairo_restore(cr);
+    // Replace a socket left behind by a crashed instance, but not a live one
+    GStatBuf st;
+    if (g_lstat(metrics_socket, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        GSocketAddress *peer = g_unix_socket_address_new(metrics_socket);
+        GSocketClient *client = g_socket_client_new();
+        GSocketConnection *live = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(peer), NULL, NULL);
+        g_object_unref(client);
+        g_object_unref(peer);
+        if (live) {
+            g_object_unref(live);
+            g_printerr("Metrics socket %s is in use by another instance\n", metrics_socket);
+            return;
+        }
+        g_unlink(metrics_socket);
     }
 
-    // Second hand shadow
-    if (g_svg_handles[CLOCK_SECOND_HAND_SHADOW]) {
-        cairo_save(cr);
-        cairo_translate(cr, SHADOW_OFFSET_X, SHADOW_OFFSET_Y);
-        cairo_rotate(cr, angle_sec_rad);
-        rsvg_handle_render_document(g_svg_handles[CLOCK_SECOND_HAND_SHADOW], cr, &viewport, NULL);
-        cairo_restore(cr);
+    GSocketAddress *address = g_unix_socket_address_new(metrics_socket);
+    metrics_service = g_socket_service_new();
+    if (g_socket_listener_add_address(G_SOCKET_LISTENER(metrics_service), address, G_SOCKET_TYPE_STREAM,
+                                      G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &err)) {
+        g_signal_connect(metrics_service, "incoming", G_CALLBACK(on_metrics_incoming), NULL);
+        g_socket_service_start(metrics_service);
+    } else {
+        g_printerr("Cannot listen on %s: %s\n", metrics_socket, err->message);
+        g_clear_error(&err);
+        g_clear_object(&metrics_service);
     }
+    g_object_unref(address);
+}
 
-    // Hour hand
-    if (g_svg_handles[CLOCK_HOUR_HAND]) {
-        cairo_save(cr);
-        cairo_rotate(cr, angle_hour_rad);
-        rsvg_handle_render_document(g_svg_handles[CLOCK_HOUR_HAND], cr, &viewport, NULL);
-        cairo_restore(cr);
-    }
+static void stop_metrics_socket(void) {
+    if (!metrics_service)
+        return;
+    g_socket_service_stop(metrics_service);
+    g_socket_listener_close(G_SOCKET_LISTENER(metrics_service));
+    g_clear_object(&metrics_service);
+    g_unlink(metrics_socket);
+}
 
-    // Minute hand
-    if (g_svg_handles[CLOCK_MINUTE_HAND]) {
-        cairo_save(cr);
-        cairo_rotate(cr, angle_min_rad);
-        rsvg_handle_render_document(g_svg_handles[CLOCK_MINUTE_HAND], cr, &viewport, NULL);
-        cairo_restore(cr);
-    }
+static const gchar metrics_introspection[] =
+    "<node>"
+    "  <interface name='" APP_NAME ".CairoClock.Metrics'>"
+    "    <property name='FramesDrawn' type='t' access='read'/>"
+    "    <property name='FramesSkipped' type='t' access='read'/>"
+    "    <property name='Wakeups' type='t' access='read'/>"
+    "    <property name='CacheRebuilds' type='t' access='read'/>"
+    "    <property name='CacheRebuildSeconds' type='d' access='read'/>"
+    "    <property name='NodesBuilt' type='t' access='read'/>"
+    "    <property name='NodesReused' type='t' access='read'/>"
+    "    <property name='TextureBytes' type='t' access='read'/>"
+    "    <property name='ResidentBytes' type='t' access='read'/>"
+    "    <property name='EffectiveHz' type='d' access='read'/>"
+    "    <property name='Strategy' type='s' access='read'/>"
+    "  </interface>"
+    "</node>";
 
-    // Second hand
-    if (g_svg_handles[CLOCK_SECOND_HAND]) {
-        cairo_save(cr);
-        cairo_rotate(cr, angle_sec_rad);
-        rsvg_handle_render_document(g_svg_handles[CLOCK_SECOND_HAND], cr, &viewport, NULL);
-        cairo_restore(cr);
-    }
+static GVariant *on_metrics_get_property(GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+                                         const gchar *interface_name, const gchar *property_name, GError **error,
+                                         gpointer user_data) {
+    if (!strcmp(property_name, "FramesDrawn"))
+        return g_variant_new_uint64(metrics.frames_drawn);
+    if (!strcmp(property_name, "FramesSkipped"))
+        return g_variant_new_uint64(metrics.frames_skipped);
+    if (!strcmp(property_name, "Wakeups"))
+        return g_variant_new_uint64(metrics.wakeups);
+    if (!strcmp(property_name, "CacheRebuilds"))
+        return g_variant_new_uint64(metrics.cache_rebuilds);
+    if (!strcmp(property_name, "CacheRebuildSeconds"))
+        return g_variant_new_double(metrics.cache_rebuild_usec / (double)G_USEC_PER_SEC);
+    if (!strcmp(property_name, "NodesBuilt"))
+        return g_variant_new_uint64(node_stats.built);
+    if (!strcmp(property_name, "NodesReused"))
+        return g_variant_new_uint64(node_stats.reused);
+    if (!strcmp(property_name, "TextureBytes"))
+        return g_variant_new_uint64(texture_bytes());
+    if (!strcmp(property_name, "ResidentBytes"))
+        return g_variant_new_uint64(resident_bytes());
+    if (!strcmp(property_name, "EffectiveHz"))
+        return g_variant_new_double(effective_hz());
+    if (!strcmp(property_name, "Strategy"))
+        return g_variant_new_string(metrics.strategy);
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "No property %s", property_name);
+    return NULL;
+}
 
-    cairo_restore(cr);
-    cairo_destroy(cr);
+// Export the metrics next to the org.gtk.Actions interface of the application
+static void export_metrics(GApplication *app) {
+    GDBusConnection *connection = g_application_get_dbus_connection(app);
+    const gchar *path = g_application_get_dbus_object_path(app);
+    GError *err = NULL;
+    if (!connection || !path || metrics_dbus_id)
+        return;
 
-    // Draw cached foreground texture (face shadow, glass, frame) above the hands
-    if (fg_cache_texture) {
-        gtk_snapshot_append_texture(snapshot, fg_cache_texture, &bounds);
+    static const GDBusInterfaceVTable vtable = {.get_property = on_metrics_get_property};
+    GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(metrics_introspection, NULL);
+    metrics_dbus_id =
+        g_dbus_connection_register_object(connection, path, info->interfaces[0], &vtable, NULL, NULL, &err);
+    if (!metrics_dbus_id) {
+        g_warning("Cannot export metrics on D-Bus: %s", err->message);
+        g_clear_error(&err);
     }
+    g_dbus_node_info_unref(info);
 }
 
-static void clock_widget_measure(GtkWidget *widget, GtkOrientation orientation, int for_size, int *minimum,
-                                 int *natural, int *minimum_baseline, int *natural_baseline) {
-    *minimum = 100;
-    *natural = 400;
+static void on_quit_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    g_application_quit(G_APPLICATION(user_data));
 }
 
-static void clock_widget_class_init(ClockWidgetClass *klass) {
-    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
-    widget_class->snapshot = clock_widget_snapshot;
-    widget_class->measure = clock_widget_measure;
+// Stopwatch controls; exported as app actions, so they are also reachable over
+// D-Bus through org.gtk.Actions
+static void stopwatch_start(void) {
+    if (stopwatch.running)
+        return;
+    stopwatch.started = g_get_monotonic_time();
+    stopwatch.running = TRUE;
+    ensure_ticking();
 }
 
-static void clock_widget_init(ClockWidget *self) {
-    gtk_widget_set_hexpand(GTK_WIDGET(self), TRUE);
-    gtk_widget_set_vexpand(GTK_WIDGET(self), TRUE);
+static void stopwatch_stop(void) {
+    if (!stopwatch.running)
+        return;
+    stopwatch.accumulated += g_get_monotonic_time() - stopwatch.started;
+    stopwatch.running = FALSE;
+    queue_draw_views(FALSE);
 }
 
-static GtkWidget *clock_widget_new(void) {
-    return g_object_new(CLOCK_TYPE_WIDGET, NULL);
+static void stopwatch_reset(void) {
+    stopwatch.accumulated = 0;
+    stopwatch.started = g_get_monotonic_time();
+    queue_draw_views(FALSE);
 }
 
-static void on_quit_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
-    g_application_quit(G_APPLICATION(user_data));
+static void on_chrono_start_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    stopwatch_start();
+}
+
+static void on_chrono_stop_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    stopwatch_stop();
+}
+
+static void on_chrono_toggle_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    if (stopwatch.running)
+        stopwatch_stop();
+    else
+        stopwatch_start();
+}
+
+static void on_chrono_reset_action(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+    stopwatch_reset();
+}
+
+// Escape dismisses a ringing alarm; space starts/stops the stopwatch, R or
+// Backspace resets it
+static gboolean on_key_pressed(GtkEventControllerKey *controller, guint keyval, guint keycode, GdkModifierType state,
+                               gpointer user_data) {
+    if (keyval == GDK_KEY_Escape && alarm_flash_until) {
+        alarm_dismiss();
+        return TRUE;
+    }
+    if (!chronograph_mode)
+        return FALSE;
+
+    switch (keyval) {
+    case GDK_KEY_space:
+        on_chrono_toggle_action(NULL, NULL, NULL);
+        return TRUE;
+    case GDK_KEY_r:
+    case GDK_KEY_R:
+    case GDK_KEY_BackSpace:
+        stopwatch_reset();
+        return TRUE;
+    default:
+        return FALSE;
+    }
 }
 
 static void save_key_file(GKeyFile *kf) {
@@ -364,6 +4744,20 @@ static void save_key_file(GKeyFile *kf) {
     g_key_file_set_integer(kf, "Settings", "hz", refresh_rate);
     g_key_file_set_boolean(kf, "Settings", "userthemes", userthemes);
     g_key_file_set_boolean(kf, "Settings", "noseconds", dont_show_seconds);
+    g_key_file_set_boolean(kf, "Settings", "railway", railway_mode);
+    g_key_file_set_boolean(kf, "Settings", "motion-blur", motion_blur);
+    g_key_file_set_boolean(kf, "Settings", "chronograph", chronograph_mode);
+    g_key_file_set_string(kf, "Settings", "complications", complications ? complications : "");
+    g_key_file_set_string(kf, "Settings", "timezone2", timezone2 ? timezone2 : "");
+    if (alarm_times)
+        g_key_file_set_string_list(kf, "Settings", "alarms", (const gchar *const *)alarm_times,
+                                   g_strv_length(alarm_times));
+    else
+        g_key_file_set_string_list(kf, "Settings", "alarms", NULL, 0);
+    g_key_file_set_string(kf, "Settings", "night", night_hours ? night_hours : "");
+    g_key_file_set_string(kf, "Settings", "tint", tint_color ? tint_color : "");
+    g_key_file_set_string(kf, "Settings", "metrics-socket", metrics_socket ? metrics_socket : "");
+    g_key_file_set_string(kf, "Settings", "quality", render_quality);
     if (!g_key_file_save_to_file(kf, config_file, &error)) {
         g_printerr("Failed to save configuration: %s\n", error->message);
         g_clear_error(&error);
@@ -375,6 +4769,8 @@ static int process_config(int argc, char **argv) {
     GError *error = NULL;
     gchar *newtheme;
     gboolean show_version = FALSE;
+    gboolean list_themes = FALSE;
+    gchar **cli_alarms = NULL;
     GOptionEntry entries[] = {
         {"width", 'w', 0, G_OPTION_ARG_INT, &clock_width, "Width of the window", "WIDTH"},
         {"height", 'h', 0, G_OPTION_ARG_INT, &clock_height, "Height of the window", "HEIGHT"},
@@ -384,6 +4780,38 @@ static int process_config(int argc, char **argv) {
         {"hz", 'z', 0, G_OPTION_ARG_INT, &refresh_rate, "Refresh rate (hz)", "HZ"},
         {"noseconds", 'n', 0, G_OPTION_ARG_NONE, &dont_show_seconds, "Don't show second hand", "NOSECONDS"},
         {"seconds", 'S', G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &dont_show_seconds, "Show second hand", NULL},
+        {"railway", 'r', 0, G_OPTION_ARG_NONE, &railway_mode, "Swiss railway stop-to-go hands", NULL},
+        {"norailway", 'R', G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &railway_mode, "Continuously moving hands", NULL},
+        {"motion-blur", 0, 0, G_OPTION_ARG_NONE, &motion_blur, "Blur the sweeping second hand between redraws",
+         NULL},
+        {"nomotion-blur", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &motion_blur, "Draw a sharp second hand",
+         NULL},
+        {"chronograph", 'c', 0, G_OPTION_ARG_NONE, &chronograph_mode, "Show stopwatch subdials", NULL},
+        {"nochronograph", 'C', G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &chronograph_mode, "Hide stopwatch subdials",
+         NULL},
+        {"complications", 'x', 0, G_OPTION_ARG_STRING, &complications,
+         "Complications to show: date, weekday, moon, 24h, tz2", "LIST"},
+        {"timezone2", 'Z', 0, G_OPTION_ARG_STRING, &timezone2, "Time zone of the tz2 hand", "ZONE"},
+        {"alarm", 'a', 0, G_OPTION_ARG_STRING_ARRAY, &cli_alarms, "Daily alarm, may be repeated", "HH:MM"},
+        {"countdown", 'd', 0, G_OPTION_ARG_INT, &countdown_seconds, "Start a countdown timer", "SECONDS"},
+        {"night", 'N', 0, G_OPTION_ARG_STRING, &night_hours, "Dim the clock between these times", "HH:MM-HH:MM"},
+        {"tint", 'T', 0, G_OPTION_ARG_STRING, &tint_color, "Accent tint for the hands", "COLOR"},
+        {"check-hints", 0, 0, G_OPTION_ARG_NONE, &check_hints, "Check theme manifest hints against rendering", NULL},
+        {"list-themes", 0, 0, G_OPTION_ARG_NONE, &list_themes, "List system and user themes and exit", NULL},
+        {"startup-report", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, (gpointer)on_startup_report_option,
+         "Report startup phase timings, as JSON to FILE if given", "FILE"},
+        {"metrics-socket", 0, 0, G_OPTION_ARG_FILENAME, &metrics_socket, "Serve metrics on this UNIX socket", "PATH"},
+        {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output_target,
+         "Render without a window to a file, shm:NAME or - for stdout", "TARGET"},
+        {"output-format", 0, 0, G_OPTION_ARG_STRING, &output_format_name,
+         "Output pixels: rgb565, gray8, mono-ordered (default) or mono-diffuse", "FORMAT"},
+        {"record-trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_path, "Record frame clock timings for clok4-trace-replay",
+         "FILE"},
+        {"quality", 0, 0, G_OPTION_ARG_STRING, &render_quality,
+         "Cache quality: auto (fast while resizing), fast or best", "QUALITY"},
+        {"dump-nodes", 0, 0, G_OPTION_ARG_CALLBACK, (gpointer)on_dump_nodes_option,
+         "Write every Nth frame's render nodes and a summary to DIR", "DIR[:N]"},
+        {"all-monitors", 0, 0, G_OPTION_ARG_NONE, &all_monitors, "Open a fullscreen clock on every monitor", NULL},
         {"version", 'v', 0, G_OPTION_ARG_NONE, &show_version, "Show application version and exit", NULL},
         {NULL}
     };
@@ -425,9 +4853,19 @@ static int process_config(int argc, char **argv) {
     theme = newtheme ? newtheme : g_strdup("default");
     refresh_rate = g_key_file_get_integer(key_file, "Settings", "hz", NULL);
     if (!refresh_rate)
-        refresh_rate = 10;
+        refresh_rate = SCHEDULE_DEFAULT_HZ;
     userthemes = g_key_file_get_boolean(key_file, "Settings", "userthemes", NULL);
     dont_show_seconds = g_key_file_get_boolean(key_file, "Settings", "noseconds", NULL);
+    railway_mode = g_key_file_get_boolean(key_file, "Settings", "railway", NULL);
+    motion_blur = g_key_file_get_boolean(key_file, "Settings", "motion-blur", NULL);
+    chronograph_mode = g_key_file_get_boolean(key_file, "Settings", "chronograph", NULL);
+    complications = g_key_file_get_string(key_file, "Settings", "complications", NULL);
+    timezone2 = g_key_file_get_string(key_file, "Settings", "timezone2", NULL);
+    alarm_times = g_key_file_get_string_list(key_file, "Settings", "alarms", NULL, NULL);
+    night_hours = g_key_file_get_string(key_file, "Settings", "night", NULL);
+    tint_color = g_key_file_get_string(key_file, "Settings", "tint", NULL);
+    metrics_socket = g_key_file_get_string(key_file, "Settings", "metrics-socket", NULL);
+    render_quality = g_key_file_get_string(key_file, "Settings", "quality", NULL);
 
     context = g_option_context_new("- Save configuration for " APP_NAME);
     g_option_context_add_main_entries(context, entries, NULL);
@@ -439,15 +4877,26 @@ static int process_config(int argc, char **argv) {
     }
     g_option_context_free(context);
 
+    // Alarms given on the command line replace the configured ones
+    if (cli_alarms) {
+        g_strfreev(alarm_times);
+        alarm_times = cli_alarms;
+    }
+
     if (show_version) {
         g_print("%s version %s\n", APP_NAME, PROJECT_VERSION);
         exit(0);
     }
 
+    if (list_themes) {
+        print_theme_list();
+        exit(0);
+    }
+
     // Validate values from the config file and the command line
     if (refresh_rate < 1 || refresh_rate > 240) {
-        g_printerr("Invalid refresh rate %d, using 10 hz\n", refresh_rate);
-        refresh_rate = 10;
+        g_printerr("Invalid refresh rate %d, using %d hz\n", refresh_rate, SCHEDULE_DEFAULT_HZ);
+        refresh_rate = SCHEDULE_DEFAULT_HZ;
     }
     if (clock_width < 100 || clock_width > 8192) {
         g_printerr("Invalid width %d, using 400\n", clock_width);
@@ -457,6 +4906,16 @@ static int process_config(int argc, char **argv) {
         g_printerr("Invalid height %d, using 400\n", clock_height);
         clock_height = 400;
     }
+    if (!g_strcmp0(render_quality, "fast")) {
+        baked_quality = QUALITY_FAST;
+    } else if (!g_strcmp0(render_quality, "best")) {
+        resize_quality = QUALITY_BEST;
+    } else if (g_strcmp0(render_quality, "auto")) {
+        if (render_quality && *render_quality)
+            g_printerr("Invalid quality %s, using auto\n", render_quality);
+        g_free(render_quality);
+        render_quality = g_strdup("auto");
+    }
 
     return 0;
 }
@@ -480,44 +4939,147 @@ static void on_window_destroy(GtkWidget *widget, gpointer user_data) {
     capture_window_size();
     // Clear dangling pointers so nothing touches the destroyed widgets
     g_window = NULL;
-    g_clock_widget = NULL;
+    clock_view_detach(&main_view);
 }
 
-static void on_app_activate_cb(GtkApplication *app, gpointer user_data) {
-    // Load theme SVGs before creating the window so a missing theme fails early
-    load_all_svgs();
-
-    load_transparent_css();
+// Window with a clock widget drawing view
+static GtkWidget *clock_window_new(GtkApplication *app, ClockView *view) {
+    GtkWidget *window = gtk_application_window_new(app);
+    gtk_window_set_title(GTK_WINDOW(window), APP_NAME);
+    gtk_window_set_decorated(GTK_WINDOW(window), FALSE);
 
-    g_window = gtk_application_window_new(app);
-    gtk_window_set_title(GTK_WINDOW(g_window), APP_NAME);
-    gtk_window_set_decorated(GTK_WINDOW(g_window), FALSE);
-    gtk_window_set_default_size(GTK_WINDOW(g_window), clock_width, clock_height);
-    g_signal_connect(g_window, "close-request", G_CALLBACK(on_close_request), NULL);
-    g_signal_connect(g_window, "destroy", G_CALLBACK(on_window_destroy), NULL);
+    GtkEventController *keys = gtk_event_controller_key_new();
+    g_signal_connect(keys, "key-pressed", G_CALLBACK(on_key_pressed), NULL);
+    gtk_widget_add_controller(window, keys);
 
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-    gtk_window_set_child(GTK_WINDOW(g_window), box);
+    gtk_window_set_child(GTK_WINDOW(window), box);
 
     GtkWidget *aspect_frame = gtk_aspect_frame_new(0.5, 0.5, 1.0, TRUE);
     gtk_widget_set_hexpand(aspect_frame, TRUE);
     gtk_widget_set_vexpand(aspect_frame, TRUE);
     gtk_box_append(GTK_BOX(box), aspect_frame);
 
-    g_clock_widget = clock_widget_new();
-    gtk_aspect_frame_set_child(GTK_ASPECT_FRAME(aspect_frame), g_clock_widget);
+    GtkWidget *clock = clock_widget_new(view);
+    gtk_aspect_frame_set_child(GTK_ASPECT_FRAME(aspect_frame), clock);
+    g_signal_connect(clock, "realize", G_CALLBACK(on_prepare_realize), view);
+    g_signal_connect(clock, "unrealize", G_CALLBACK(on_prepare_unrealize), view);
+    clock_view_attach(view);
+    if (!startup_view)
+        startup_view = view;
+    start_trace_recording(clock);
 
     gtk_widget_set_visible(box, TRUE);
+    return window;
+}
+
+static void on_monitor_window_destroy(GtkWidget *window, gpointer user_data) {
+    ClockView *view = user_data;
+    g_ptr_array_remove(monitor_windows, window);
+    clock_view_detach(view);
+    g_clear_object(&view->monitor);
+    g_free(view);
+}
+
+static ClockView *monitor_window_view(GtkWidget *window) {
+    return g_object_get_data(G_OBJECT(window), "clock-view");
+}
+
+// Keep one fullscreen clock per monitor as monitors come and go. The views
+// share the theme and, between monitors of the same size and scale, the cached
+// textures; each ticks on its own window's frame clock
+static void sync_monitor_windows(GListModel *monitors, guint position, guint removed, guint added,
+                                 gpointer user_data) {
+    GtkApplication *app = user_data;
+
+    for (guint i = monitor_windows->len; i-- > 0;) {
+        GtkWidget *window = g_ptr_array_index(monitor_windows, i);
+        GdkMonitor *monitor = monitor_window_view(window)->monitor;
+        gboolean present = FALSE;
+        for (guint m = 0; !present && m < g_list_model_get_n_items(monitors); m++) {
+            GdkMonitor *item = g_list_model_get_item(monitors, m);
+            present = item == monitor;
+            g_object_unref(item);
+        }
+        if (!present)
+            gtk_window_destroy(GTK_WINDOW(window));
+    }
+
+    for (guint m = 0; m < g_list_model_get_n_items(monitors); m++) {
+        GdkMonitor *monitor = g_list_model_get_item(monitors, m);
+        gboolean open = FALSE;
+        for (guint i = 0; !open && i < monitor_windows->len; i++) {
+            open = monitor_window_view(g_ptr_array_index(monitor_windows, i))->monitor == monitor;
+        }
+        if (!open) {
+            ClockView *view = g_new0(ClockView, 1);
+            view->hands_dirty = TRUE;
+            view->monitor = g_object_ref(monitor);
+            GtkWidget *window = clock_window_new(app, view);
+            g_object_set_data(G_OBJECT(window), "clock-view", view);
+            g_signal_connect(window, "destroy", G_CALLBACK(on_monitor_window_destroy), view);
+            g_ptr_array_add(monitor_windows, window);
+            gtk_window_fullscreen_on_monitor(GTK_WINDOW(window), monitor);
+            ensure_view_ticking(view);
+            gtk_window_present(GTK_WINDOW(window));
+            g_debug("Clock window on monitor %s", gdk_monitor_get_connector(monitor));
+        }
+        g_object_unref(monitor);
+    }
+}
+
+static void on_app_activate_cb(GtkApplication *app, gpointer user_data) {
+    // Load theme SVGs before creating the window so a missing theme fails early
+    load_all_svgs();
+    if (check_hints)
+        validate_layer_hints();
+    setup_complications();
+    setup_alarms();
+    setup_night_mode();
+    watch_theme_dir();
+    start_metrics_socket();
+    export_metrics(G_APPLICATION(app));
+    set_action_state("hz", g_variant_new_int32(refresh_rate));
+    set_action_state("seconds", g_variant_new_boolean(!dont_show_seconds));
+    set_action_state("size", g_variant_new("(ii)", clock_width, clock_height));
+    watch_config_file();
+
+    load_transparent_css();
 
     g_clock_timer = g_timer_new();
+
+    if (all_monitors) {
+        // No main window: the monitor windows come and go with the monitors, and
+        // the application is held so it outlives a moment without any
+        monitor_windows = g_ptr_array_new();
+        GListModel *monitors = gdk_display_get_monitors(gdk_display_get_default());
+        g_signal_connect(monitors, "items-changed", G_CALLBACK(sync_monitor_windows), app);
+        sync_monitor_windows(monitors, 0, 0, 0, app);
+        g_application_hold(G_APPLICATION(app));
+        startup_mark("window-present", NULL);
+        return;
+    }
+
+    g_window = clock_window_new(app, &main_view);
+    gtk_window_set_default_size(GTK_WINDOW(g_window), clock_width, clock_height);
+    g_signal_connect(g_window, "close-request", G_CALLBACK(on_close_request), NULL);
+    g_signal_connect(g_window, "destroy", G_CALLBACK(on_window_destroy), NULL);
+
     // Frame-synced redraws; the callback is removed automatically when the widget is destroyed
-    gtk_widget_add_tick_callback(g_clock_widget, tick, NULL, NULL);
+    ensure_ticking();
 
     gtk_window_present(GTK_WINDOW(g_window));
+    startup_mark("window-present", NULL);
 }
 
 int main(int argc, char **argv) {
+    // Collected from the start and dropped if no report is wanted
+    startup_marks = g_array_new(FALSE, FALSE, sizeof(StartupMark));
+    startup_mark_at("exec", NULL, process_start_time());
+    startup_mark("main", NULL);
+
     tzset();
+    clock_views = g_ptr_array_new();
 
     // NON_UNIQUE allows running multiple independent instances
     GtkApplication *app = gtk_application_new(APP_NAME ".CairoClock", G_APPLICATION_NON_UNIQUE);
@@ -525,13 +5087,50 @@ int main(int argc, char **argv) {
     g_signal_connect(quit_action, "activate", G_CALLBACK(on_quit_action), app);
     g_action_map_add_action(G_ACTION_MAP(app), G_ACTION(quit_action));
 
+    static const GActionEntry chrono_actions[] = {
+        {.name = "chrono-start", .activate = on_chrono_start_action},
+        {.name = "chrono-stop", .activate = on_chrono_stop_action},
+        {.name = "chrono-toggle", .activate = on_chrono_toggle_action},
+        {.name = "chrono-reset", .activate = on_chrono_reset_action},
+    };
+    g_action_map_add_action_entries(G_ACTION_MAP(app), chrono_actions, G_N_ELEMENTS(chrono_actions), NULL);
+
+    static const GActionEntry theme_actions[] = {
+        {.name = "theme", .activate = on_theme_action, .parameter_type = "s"},
+        {.name = "user-themes", .activate = on_user_themes_action, .parameter_type = "b"},
+        {.name = "pick-theme", .activate = on_pick_theme_action},
+    };
+    g_action_map_add_action_entries(G_ACTION_MAP(app), theme_actions, G_N_ELEMENTS(theme_actions), app);
+
+    // States are set from the configuration once it is loaded
+    static const GActionEntry control_actions[] = {
+        {.name = "hz", .parameter_type = "i", .state = "10", .change_state = on_hz_change},
+        {.name = "seconds", .state = "true", .change_state = on_seconds_change},
+        {.name = "size", .parameter_type = "(ii)", .state = "(400, 400)", .change_state = on_size_change},
+    };
+    g_action_map_add_action_entries(G_ACTION_MAP(app), control_actions, G_N_ELEMENTS(control_actions), NULL);
+
     if (process_config(argc, argv) != 0) {
         exit(EXIT_FAILURE);
     }
+    startup_mark("process-config", NULL);
+    if (!startup_report)
+        g_clear_pointer(&startup_marks, g_array_unref);
+
+    // Headless output leaves the configuration alone
+    if (output_target) {
+        int status = run_output();
+        startup_report_finish();
+        g_object_unref(app);
+        return status;
+    }
 
     const char *quit_accel[2] = {"<Control>q", NULL};
     gtk_application_set_accels_for_action(GTK_APPLICATION(app), "app.quit", quit_accel);
+    const char *pick_theme_accel[2] = {"<Control>t", NULL};
+    gtk_application_set_accels_for_action(GTK_APPLICATION(app), "app.pick-theme", pick_theme_accel);
 
+    g_signal_connect_after(app, "startup", G_CALLBACK(on_app_startup), NULL);
     g_signal_connect(app, "activate", G_CALLBACK(on_app_activate_cb), NULL);
 
     int status = g_application_run(G_APPLICATION(app), argc, argv);
@@ -543,6 +5142,13 @@ int main(int argc, char **argv) {
     if (g_window) {
         gtk_window_destroy(GTK_WINDOW(g_window));
     }
+    if (monitor_windows) {
+        g_signal_handlers_disconnect_by_func(gdk_display_get_monitors(gdk_display_get_default()),
+                                             sync_monitor_windows, app);
+        while (monitor_windows->len)
+            gtk_window_destroy(GTK_WINDOW(g_ptr_array_index(monitor_windows, monitor_windows->len - 1)));
+        g_clear_pointer(&monitor_windows, g_ptr_array_unref);
+    }
     if (!size_saved) {
         resized_width = clock_width;
         resized_height = clock_height;
@@ -559,16 +5165,55 @@ int main(int argc, char **argv) {
     g_free(config_dir);
     g_free(config_file);
 
-    // Cleanup cached textures
-    g_clear_object(&bg_cache_texture);
-    g_clear_object(&fg_cache_texture);
+    if (theme_reload_id)
+        g_source_remove(theme_reload_id);
+    g_clear_object(&theme_monitor);
+
+    if (config_reload_id)
+        g_source_remove(config_reload_id);
+    g_clear_object(&config_monitor);
+    g_free(render_quality);
+    stop_metrics_socket();
+    startup_report_finish();  // the first frame never came
+    g_free(startup_report_file);
+    if (trace_file)
+        fclose(trace_file);
+    g_free(trace_path);
+    if (node_dump_summary)
+        fclose(node_dump_summary);
+    g_free(node_dump_dir);
+    g_free(metrics_socket);
+    g_clear_pointer(&metrics.cache_sizes, g_hash_table_unref);
+
+    guint64 nodes = node_stats.built + node_stats.reused;
+    if (nodes)
+        g_debug("Render nodes: %" G_GUINT64_FORMAT " built, %" G_GUINT64_FORMAT " reused (%.1f%%), %" G_GUINT64_FORMAT
+                " prepared ahead",
+                node_stats.built, node_stats.reused, 100.0 * node_stats.reused / nodes, node_stats.prepared);
+    if (thumbnail_pool)
+        g_thread_pool_free(thumbnail_pool, TRUE, TRUE);
+    g_free(thumbnail_dir);
+    g_clear_pointer(&theme_hashes, g_hash_table_unref);
+
+    // Cleanup cached textures of views without a window, e.g. --output
+    while (clock_views->len)
+        clock_view_detach(g_ptr_array_index(clock_views, clock_views->len - 1));
+    g_clear_pointer(&clock_views, g_ptr_array_unref);
+    g_clear_pointer(&timezone2_tz, g_time_zone_unref);
+    g_clear_pointer(&clock_alarms, g_ptr_array_unref);
+    g_strfreev(alarm_times);
+    g_free(complications);
+    g_free(timezone2);
+    g_free(night_hours);
+    g_free(tint_color);
 
-    // Cleanup all RsvgHandles
+    // Cleanup all RsvgHandles and raster assets
     for (int i = 0; i < CLOCK_ELEMENTS; i++) {
         if (g_svg_handles[i]) {
             g_object_unref(g_svg_handles[i]);
             g_svg_handles[i] = NULL;
         }
+        layer_raster_clear(&layer_rasters[i]);
     }
 
     g_object_unref(app);
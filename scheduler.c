@@ -0,0 +1,125 @@
+#include <math.h>
+
+#include "scheduler.h"
+
+// Redraw scheduling, shared by clok4 and clok4-trace-replay
+
+// Snap the redraw interval to a whole number of vblanks when it is within this
+// fraction of one, e.g. 29.5 hz on a 60 hz display becomes every other vblank
+#define PACER_SNAP_TOLERANCE 0.03
+
+// Phase-accumulating frame pacer. Redraws can only land on vblanks, so instead
+// of restarting the interval at every redraw (which rounds each interval up to
+// the next vblank: 50 hz on 60 hz gives 30 fps) the time since the last redraw
+// is carried over, spreading redraws across vblanks Bresenham-style so the
+// average rate matches the requested one
+void frame_pacer_reset(FramePacer *pacer) {
+    pacer->last_frame_time = 0;
+    pacer->phase = 0;
+}
+
+gint64 frame_pacer_interval(int hz, gint64 refresh_interval) {
+    gint64 interval = G_USEC_PER_SEC / hz;
+    if (refresh_interval > 0) {
+        double vblanks = (double)interval / refresh_interval;
+        double snapped = round(vblanks);
+        if (snapped >= 1.0 && fabs(vblanks - snapped) <= snapped * PACER_SNAP_TOLERANCE)
+            interval = (gint64)snapped * refresh_interval;
+    }
+    return interval;
+}
+
+gboolean frame_pacer_step(FramePacer *pacer, gint64 now, gint64 refresh_interval, int hz) {
+    gint64 interval = frame_pacer_interval(hz, refresh_interval);
+    gint64 elapsed = now - pacer->last_frame_time;
+    gboolean first = pacer->last_frame_time == 0;
+
+    pacer->last_frame_time = now;
+    // First frame, time going backwards or a long stall (suspend, clock step):
+    // draw now and start a fresh phase instead of trying to catch up
+    if (first || elapsed <= 0 || elapsed > G_USEC_PER_SEC) {
+        pacer->phase = 0;
+        return TRUE;
+    }
+
+    gint64 threshold = interval;
+    if (refresh_interval > 0) {
+        // Frame times jitter around the vblank grid; count whole vblanks so the
+        // phase does not drift, and redraw on the vblank nearest the deadline
+        gint64 vblanks = MAX((elapsed + refresh_interval / 2) / refresh_interval, 1);
+        elapsed = vblanks * refresh_interval;
+        threshold = interval - refresh_interval / 2;
+    }
+
+    pacer->phase += elapsed;
+    if (pacer->phase < threshold)
+        return FALSE;
+
+    pacer->phase -= interval;
+    // Fell behind by more than one interval (dropped frames): don't burst
+    if (pacer->phase >= interval)
+        pacer->phase = 0;
+    return TRUE;
+}
+
+ClockMotion clock_motion(const struct timespec *ts, const ScheduleSettings *settings, gint64 *still_usec) {
+    if (!settings->railway)
+        return MOTION_SWEEP;
+
+    // Local minutes start at whole-minute UTC offsets, so the epoch seconds suffice
+    double second = ts->tv_sec % 60 + ts->tv_nsec / 1e9;
+    if (second < RAILWAY_JUMP_SECONDS)
+        return MOTION_BURST;
+    if (settings->seconds && second < RAILWAY_SWEEP_SECONDS)
+        return MOTION_SWEEP;
+
+    *still_usec = (gint64)ceil((60.0 - second) * G_USEC_PER_SEC);
+    return MOTION_STILL;
+}
+
+void clock_scheduler_reset(ClockScheduler *scheduler) {
+    frame_pacer_reset(&scheduler->clock_pacer);
+    frame_pacer_reset(&scheduler->overlay_pacer);
+}
+
+// Paced to the refresh rate while the hands sweep and at full frame rate during
+// short animations; overlays at overlay_hz are paced separately, so they never
+// redraw the hands
+void clock_scheduler_step(ClockScheduler *scheduler, const ScheduleSettings *settings,
+                          const struct timespec *realtime, gint64 frame_time, gint64 refresh_interval,
+                          int overlay_hz, ScheduleDecision *decision) {
+    gint64 still_usec = 0;
+    *decision = (ScheduleDecision){0};
+
+    decision->motion = clock_motion(realtime, settings, &still_usec);
+    switch (decision->motion) {
+    case MOTION_BURST:
+        frame_pacer_reset(&scheduler->clock_pacer);
+        decision->hands = TRUE;
+        break;
+    case MOTION_STILL:
+        // Draw the resting position once, then let the frame clock idle until
+        // the hands move again instead of waking up every vblank
+        if (!scheduler->hands_resting)
+            decision->hands = TRUE;
+        if (!overlay_hz) {
+            decision->rest_usec = MAX(still_usec, 1);
+            decision->strategy = "resting";
+            scheduler->hands_resting = TRUE;
+            return;
+        }
+        break;
+    case MOTION_SWEEP:
+        scheduler->sweep_interval = frame_pacer_interval(settings->hz, refresh_interval);
+        if (frame_pacer_step(&scheduler->clock_pacer, frame_time, refresh_interval, settings->hz))
+            decision->hands = TRUE;
+        break;
+    }
+    scheduler->hands_resting = decision->motion == MOTION_STILL;
+    decision->strategy = decision->motion == MOTION_STILL   ? "still"
+                         : decision->motion == MOTION_BURST ? "burst"
+                                                            : "sweep";
+
+    decision->overlays =
+        overlay_hz && frame_pacer_step(&scheduler->overlay_pacer, frame_time, refresh_interval, overlay_hz);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <time.h>
+#include <glib.h>
+
+// Redraw scheduling, shared by clok4 and clok4-trace-replay. Nothing here
+// touches GTK, so recorded frame-clock timelines can be replayed into it
+
+// Swiss railway clock: the second hand sweeps a minute in RAILWAY_SWEEP_SECONDS,
+// waits at 12 for the minute to complete, and the minute hand then jumps to the
+// next minute over RAILWAY_JUMP_SECONDS
+#define RAILWAY_SWEEP_SECONDS 58.5
+#define RAILWAY_JUMP_SECONDS  0.3
+
+// How the hands move at a given moment; decides how often tick() redraws
+typedef enum {
+    MOTION_STILL = 0,  // nothing moves until the next minute
+    MOTION_SWEEP,      // continuous motion, redraw at the refresh rate
+    MOTION_BURST,      // short animation, redraw every frame
+} ClockMotion;
+
+// Hand redraws per second while sweeping, unless configured otherwise
+#define SCHEDULE_DEFAULT_HZ 10
+
+// Settings the schedule depends on
+typedef struct {
+    int hz;            // hand redraws per second while sweeping
+    gboolean railway;  // Swiss railway stop-to-go hands
+    gboolean seconds;  // second hand shown
+} ScheduleSettings;
+
+// Phase-accumulating frame pacer, see frame_pacer_step()
+typedef struct {
+    gint64 last_frame_time;  // frame time of the previous tick, 0 before the first
+    gint64 phase;            // time accumulated towards the next redraw, in usec
+} FramePacer;
+
+typedef struct {
+    FramePacer clock_pacer;
+    FramePacer overlay_pacer;
+    gboolean hands_resting;
+    gint64 sweep_interval;  // usec between hand redraws while sweeping
+} ClockScheduler;
+
+// What one frame clock tick should do
+typedef struct {
+    ClockMotion motion;
+    gboolean hands;        // the hands moved and must be redrawn
+    gboolean overlays;     // overlays animating at their own rate are due
+    gint64 rest_usec;      // nonzero: stop ticking and resume after this long
+    const char *strategy;  // sweep, burst, still or resting
+} ScheduleDecision;
+
+void frame_pacer_reset(FramePacer *pacer);
+
+// Effective redraw interval for hz on a display refreshing every refresh_interval
+// usec (0 if unknown): the ideal interval, or a whole number of vblanks if close
+gint64 frame_pacer_interval(int hz, gint64 refresh_interval);
+
+// Advance the pacer to frame time now; returns TRUE if this frame should be redrawn
+gboolean frame_pacer_step(FramePacer *pacer, gint64 now, gint64 refresh_interval, int hz);
+
+// Motion at realtime ts; *still_usec is set to the time until motion resumes
+ClockMotion clock_motion(const struct timespec *ts, const ScheduleSettings *settings, gint64 *still_usec);
+
+// Start pacing afresh, as when the tick callback is (re)installed
+void clock_scheduler_reset(ClockScheduler *scheduler);
+
+// Decide one tick at monotonic frame_time and wall-clock time realtime;
+// overlay_hz is the rate of overlays animating independently, 0 for none
+void clock_scheduler_step(ClockScheduler *scheduler, const ScheduleSettings *settings,
+                          const struct timespec *realtime, gint64 frame_time, gint64 refresh_interval,
+                          int overlay_hz, ScheduleDecision *decision);
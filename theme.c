@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "theme.h"
+
+// Theme layers, the SVG loader and raster asset lookup, shared by clok4 and
+// clok4-theme-profile
+
+const LayerFile layer_files[CLOCK_ELEMENTS] = {
+    [CLOCK_DROP_SHADOW] = {"clock-drop-shadow.svg", TRUE},
+    [CLOCK_FACE] = {"clock-face.svg", TRUE},
+    [CLOCK_MARKS] = {"clock-marks.svg", FALSE},
+    [CLOCK_HOUR_HAND_SHADOW] = {"clock-hour-hand-shadow.svg", FALSE},
+    [CLOCK_MINUTE_HAND_SHADOW] = {"clock-minute-hand-shadow.svg", FALSE},
+    [CLOCK_SECOND_HAND_SHADOW] = {"clock-second-hand-shadow.svg", FALSE},
+    [CLOCK_HOUR_HAND] = {"clock-hour-hand.svg", TRUE},
+    [CLOCK_MINUTE_HAND] = {"clock-minute-hand.svg", TRUE},
+    [CLOCK_SECOND_HAND] = {"clock-second-hand.svg", FALSE},
+    [CLOCK_CHRONO_SECONDS_HAND] = {"clock-chrono-seconds-hand.svg", FALSE},
+    [CLOCK_CHRONO_MINUTES_HAND] = {"clock-chrono-minutes-hand.svg", FALSE},
+    [CLOCK_CHRONO_TENTHS_HAND] = {"clock-chrono-tenths-hand.svg", FALSE},
+    [CLOCK_FACE_SHADOW] = {"clock-face-shadow.svg", FALSE},
+    [CLOCK_GLASS] = {"clock-glass.svg", FALSE},
+    [CLOCK_FRAME] = {"clock-frame.svg", FALSE},
+};
+
+gboolean layer_is_shadow(LayerElement e) {
+    return e == CLOCK_HOUR_HAND_SHADOW || e == CLOCK_MINUTE_HAND_SHADOW || e == CLOCK_SECOND_HAND_SHADOW;
+}
+
+gboolean layer_is_dynamic(LayerElement e) {
+    return layer_is_shadow(e) || e == CLOCK_HOUR_HAND || e == CLOCK_MINUTE_HAND || e == CLOCK_SECOND_HAND ||
+           e == CLOCK_CHRONO_SECONDS_HAND || e == CLOCK_CHRONO_MINUTES_HAND || e == CLOCK_CHRONO_TENTHS_HAND;
+}
+
+RsvgHandle *theme_load_svg(const char *dir, const char *file, GError **error) {
+    gchar *path = g_build_filename(dir, file, NULL);
+    RsvgHandle *handle = rsvg_handle_new_from_file(path, error);
+    g_free(path);
+    return handle;
+}
+
+// Whether name is FILE@SIZE.png or .webp for the layer file FILE.svg
+static gboolean raster_name_matches(const char *name, const char *file, int *size) {
+    size_t base = strlen(file) - strlen(".svg");
+    if (strncmp(name, file, base) || name[base] != '@')
+        return FALSE;
+
+    char *end;
+    long n = strtol(name + base + 1, &end, 10);
+    if (end == name + base + 1 || n < 1 || n > 16384 || (strcmp(end, ".png") && strcmp(end, ".webp")))
+        return FALSE;
+    *size = (int)n;
+    return TRUE;
+}
+
+static void theme_raster_free(gpointer data) {
+    ThemeRaster *raster = data;
+    g_free(raster->path);
+    g_free(raster);
+}
+
+static gint theme_raster_compare(gconstpointer a, gconstpointer b) {
+    const ThemeRaster *x = *(const ThemeRaster *const *)a, *y = *(const ThemeRaster *const *)b;
+    return x->size - y->size;
+}
+
+GPtrArray *theme_find_rasters(const char *dir, const char *file) {
+    GDir *d = g_dir_open(dir, 0, NULL);
+    GPtrArray *rasters = NULL;
+    const gchar *name;
+    int size;
+
+    while (d && (name = g_dir_read_name(d))) {
+        if (!raster_name_matches(name, file, &size))
+            continue;
+        if (!rasters)
+            rasters = g_ptr_array_new_with_free_func(theme_raster_free);
+        ThemeRaster *raster = g_new0(ThemeRaster, 1);
+        raster->size = size;
+        raster->path = g_build_filename(dir, name, NULL);
+        g_ptr_array_add(rasters, raster);
+    }
+    if (d)
+        g_dir_close(d);
+    if (rasters)
+        g_ptr_array_sort(rasters, theme_raster_compare);
+    return rasters;
+}
+
+const ThemeRaster *theme_pick_raster(GPtrArray *rasters, int width) {
+    for (guint i = 0; i < rasters->len; i++) {
+        const ThemeRaster *raster = g_ptr_array_index(rasters, i);
+        if (raster->size >= width)
+            return raster;
+    }
+    return g_ptr_array_index(rasters, rasters->len - 1);
+}
+
+int theme_raster_layer(const char *name) {
+    int size;
+    for (int e = 0; e < CLOCK_ELEMENTS; e++) {
+        if (raster_name_matches(name, layer_files[e].file, &size))
+            return e;
+    }
+    return -1;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glib.h>
+#include <librsvg/rsvg.h>
+
+// Theme layers, the SVG loader and raster asset lookup, shared by clok4 and
+// clok4-theme-profile
+
+typedef enum {
+    CLOCK_DROP_SHADOW = 0,
+    CLOCK_FACE,
+    CLOCK_MARKS,
+    CLOCK_HOUR_HAND_SHADOW,
+    CLOCK_MINUTE_HAND_SHADOW,
+    CLOCK_SECOND_HAND_SHADOW,
+    CLOCK_HOUR_HAND,
+    CLOCK_MINUTE_HAND,
+    CLOCK_SECOND_HAND,
+    CLOCK_CHRONO_SECONDS_HAND,
+    CLOCK_CHRONO_MINUTES_HAND,
+    CLOCK_CHRONO_TENTHS_HAND,
+    CLOCK_FACE_SHADOW,
+    CLOCK_GLASS,
+    CLOCK_FRAME,
+    CLOCK_ELEMENTS
+} LayerElement;
+
+typedef struct {
+    const char *file;
+    gboolean needed;  // a theme without this layer is unusable
+} LayerFile;
+
+extern const LayerFile layer_files[CLOCK_ELEMENTS];
+
+gboolean layer_is_shadow(LayerElement e);
+
+// Whether clok4 draws layer e rotated (unless the theme manifest says otherwise)
+gboolean layer_is_dynamic(LayerElement e);
+
+// Load file from the theme directory dir
+RsvgHandle *theme_load_svg(const char *dir, const char *file, GError **error);
+
+// Pre-rendered raster asset of a layer: FILE@SIZE.png or FILE@SIZE.webp next
+// to FILE.svg, SIZE pixels wide
+typedef struct {
+    int size;
+    gchar *path;
+} ThemeRaster;
+
+// Raster assets of layer file in dir, smallest first; NULL if there are none
+GPtrArray *theme_find_rasters(const char *dir, const char *file);
+
+// Asset to rasterize at width pixels: the smallest at least that wide, else the largest
+const ThemeRaster *theme_pick_raster(GPtrArray *rasters, int width);
+
+// Layer that name is a raster asset of, or -1
+int theme_raster_layer(const char *name);